@@ -0,0 +1,58 @@
+#pragma once
+#include "markers.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Wall-clock seconds taken by fn(), best of `repeats` runs
+template <typename Fn>
+double bestTime(int repeats, Fn&& fn) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+// Value at fraction q of the sorted samples, times is reordered
+inline double percentile(std::vector<double>& times, double q) {
+    if (times.empty()) return 0.0;
+    size_t index = std::min(times.size() - 1, static_cast<size_t>(q * times.size()));
+    std::nth_element(times.begin(), times.begin() + index, times.end());
+    return times[index];
+}
+
+// --quick keeps the inputs small enough for every commit, the full run goes
+// up to 4 h of audio and 1M markers
+bool benchQuick();
+// Scratch directory for generated WAV and CSV files, removed on exit
+const std::string& benchScratchDir();
+
+// 16-bit 48 kHz WAV of the given length with a few tones and noise, in the
+// scratch directory. Written once per run and reused by later suites, empty
+// when it cannot be written.
+std::string syntheticWav(size_t minutes, size_t numChannels);
+// Random markers over numSamples, every tenth a section a few seconds long
+std::vector<Marker> syntheticMarkers(size_t count, size_t numSamples, unsigned seed = 42);
+
+// ImGui and ImPlot contexts with no backend for timing the CPU side of
+// frames, see bench_frame.cpp
+void beginHeadless(float width, float height);
+void endHeadless();
+
+// Adds a measurement to the JSON report. name identifies the case, e.g.
+// "mapped/60min", and should stay stable so runs can be compared.
+void recordResult(const std::string& suite, const std::string& name, const std::string& metric,
+                  double value, const char* unit);
+
+void benchDecode();
+void benchMarkers();
+void benchLoad();
+void benchCsv();
+void benchEdit();
+void benchFrame();
+void benchResample();
@@ -0,0 +1,123 @@
+#include "bench.h"
+#include "markers.h"
+#include "marker_store.h"
+#include "sidecar.h"
+#include <filesystem>
+#include <random>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+static constexpr size_t kNumSamples = 48000ull * 3600 * 4;  // 4 h at 48 kHz
+
+std::vector<Marker> syntheticMarkers(size_t count, size_t numSamples, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> sampleDist(1, numSamples - 1);
+    std::uniform_int_distribution<int> intensityDist(0, 3);
+    std::vector<Marker> marks;
+    marks.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t sample = sampleDist(rng);
+        if (i % 10 == 0) {
+            marks.push_back({sample, -1, std::min(sample + 48000 * 3, numSamples - 1)});
+        } else {
+            marks.push_back({sample, intensityDist(rng), 0});
+        }
+    }
+    return marks;
+}
+
+static std::vector<size_t> markerCounts() {
+    std::vector<size_t> counts = {10, 1000, 100000};
+    if (!benchQuick()) counts.push_back(1000000);
+    return counts;
+}
+
+// Markers file round trips: the CSV the viewer saves and loads, and the
+// binary sidecar that replaces the load when it is current
+void benchCsv() {
+    printf("csv: markers over %zu samples\n", kNumSamples);
+    printf("%-8s %12s %12s %12s %12s\n", "markers", "save ms", "load ms", "amk save ms", "amk load ms");
+    std::string csvPath = (fs::path(benchScratchDir()) / "bench_markers.csv").string();
+    std::string amkPath = (fs::path(benchScratchDir()) / "bench_markers.amk").string();
+    for (size_t count : markerCounts()) {
+        MarkerStore store;
+        store.assign(syntheticMarkers(count, kNumSamples));
+        std::vector<Marker> marks = store.toVector();
+        int repeats = count >= 1000000 ? 2 : 5;
+
+        double save = bestTime(repeats, [&] { saveMarkersCsv(csvPath, marks); });
+        double load = bestTime(repeats, [&] {
+            std::vector<Marker> loaded;
+            loadMarkersCsv(csvPath, loaded);
+        });
+
+        SidecarFile::Content content;
+        content.markers = &marks;
+        double sidecarSave = bestTime(repeats, [&] { SidecarFile::write(amkPath, content); });
+        double sidecarLoad = bestTime(repeats, [&] {
+            SidecarFile sidecar;
+            std::vector<Marker> loaded;
+            if (sidecar.open(amkPath)) sidecar.readMarkers(loaded);
+        });
+
+        printf("%-8zu %12.3f %12.3f %12.3f %12.3f\n", count, save * 1e3, load * 1e3, sidecarSave * 1e3, sidecarLoad * 1e3);
+        std::string name = std::to_string(count);
+        recordResult("csv", name + "/save", "time", save * 1e3, "ms");
+        recordResult("csv", name + "/load", "time", load * 1e3, "ms");
+        recordResult("csv", name + "/sidecar-save", "time", sidecarSave * 1e3, "ms");
+        recordResult("csv", name + "/sidecar-load", "time", sidecarLoad * 1e3, "ms");
+    }
+}
+
+// Single marker edits against stores of growing size, the cost of a click
+void benchEdit() {
+    const size_t numEdits = 1000;
+    printf("edit: %zu random single edits per store size\n", numEdits);
+    printf("%-8s %12s %12s %12s %14s\n", "markers", "insert ns", "erase ns", "modify ns", "eraseAll ns");
+    for (size_t count : markerCounts()) {
+        MarkerStore base;
+        base.assign(syntheticMarkers(count, kNumSamples));
+        std::vector<Marker> edits = syntheticMarkers(numEdits, kNumSamples, 7);
+        std::vector<Marker> points;
+        for (const Marker& m : edits) {
+            if (!MarkerStore::isSection(m)) points.push_back(m);
+        }
+
+        // Every timed run starts from the same store
+        MarkerStore store;
+        double insert = 1e30, erase = 1e30, eraseAll = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            store = base;
+            insert = std::min(insert, bestTime(1, [&] { for (const Marker& m : edits) store.insert(m); }));
+            MarkerStore copy = store;
+            erase = std::min(erase, bestTime(1, [&] { for (const Marker& m : edits) store.erase(m); }));
+            eraseAll = std::min(eraseAll, bestTime(1, [&] { copy.eraseAll(points); }));
+        }
+
+        // Dragging a section: one modify per frame
+        store = base;
+        std::mt19937 rng(3);
+        double modify = 1e30;
+        if (store.numSections() > 0) {
+            modify = bestTime(3, [&] {
+                for (size_t i = 0; i < numEdits; ++i) {
+                    size_t index = rng() % store.numSections();
+                    const Marker& s = store.section(index);
+                    store.modifySection(index, s.sample + 1, s.end + 1);
+                }
+            });
+        }
+
+        double insertNs = insert / numEdits * 1e9;
+        double eraseNs = erase / numEdits * 1e9;
+        double modifyNs = store.numSections() > 0 ? modify / numEdits * 1e9 : 0.0;
+        double eraseAllNs = eraseAll / std::max<size_t>(points.size(), 1) * 1e9;
+        printf("%-8zu %12.1f %12.1f %12.1f %14.1f\n", count, insertNs, eraseNs, modifyNs, eraseAllNs);
+        std::string name = std::to_string(count);
+        recordResult("edit", name + "/insert", "time", insertNs, "ns/op");
+        recordResult("edit", name + "/erase", "time", eraseNs, "ns/op");
+        recordResult("edit", name + "/modify-section", "time", modifyNs, "ns/op");
+        recordResult("edit", name + "/erase-all", "time", eraseAllNs, "ns/op");
+    }
+}
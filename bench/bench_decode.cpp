@@ -0,0 +1,49 @@
+#include "bench.h"
+#include "pcm_decode.h"
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+
+// PCM to float32 throughput per format, for the scalar and dispatched kernels
+void benchDecode() {
+    const size_t numSamples = 16 << 20;
+    const SampleFormat formats[] = {
+        SampleFormat::UInt8, SampleFormat::Int16, SampleFormat::Int24,
+        SampleFormat::Int32, SampleFormat::Float32, SampleFormat::Float64
+    };
+
+    std::vector<float> out(numSamples);
+    std::mt19937 rng(42);
+
+    printf("decode: %zu samples, dispatched kernel: %s\n", numSamples, decodeKernelName());
+    printf("%-8s %14s %14s %14s\n", "format", "scalar GB/s", "dispatch GB/s", "Msamples/s");
+    for (SampleFormat format : formats) {
+        size_t bytes = numSamples * bytesPerSample(format);
+        std::vector<uint8_t> in(bytes);
+        if (format == SampleFormat::Float32 || format == SampleFormat::Float64) {
+            std::uniform_real_distribution<double> dist(-1.0, 1.0);
+            for (size_t i = 0; i < numSamples; ++i) {
+                if (format == SampleFormat::Float32) {
+                    float v = static_cast<float>(dist(rng));
+                    memcpy(&in[i * 4], &v, 4);
+                } else {
+                    double v = dist(rng);
+                    memcpy(&in[i * 8], &v, 8);
+                }
+            }
+        } else {
+            for (auto& b : in) b = static_cast<uint8_t>(rng());
+        }
+
+        double scalar = bestTime(5, [&] { decodePCMScalar(format, in.data(), out.data(), numSamples); });
+        double dispatched = bestTime(5, [&] { decodePCM(format, in.data(), out.data(), numSamples); });
+        // Throughput is measured on the encoded input
+        printf("%-8s %14.2f %14.2f %14.1f\n", sampleFormatName(format),
+            bytes / scalar / 1e9, bytes / dispatched / 1e9, numSamples / dispatched / 1e6);
+        recordResult("decode", std::string(sampleFormatName(format)) + "/scalar", "throughput", bytes / scalar / 1e9, "GB/s");
+        recordResult("decode", std::string(sampleFormatName(format)) + "/dispatch", "throughput", bytes / dispatched / 1e9, "GB/s");
+    }
+}
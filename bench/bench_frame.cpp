@@ -0,0 +1,124 @@
+#include "bench.h"
+#include "audio_processor.h"
+#include "marker_batch.h"
+#include "marker_store.h"
+#include "waveform_plot.h"
+#include "imgui.h"
+#include "implot.h"
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+// ImGui and ImPlot run without a platform or renderer backend: the display
+// size is set by hand, the font atlas is built but never uploaded and the
+// draw data is dropped after Render(). What is left is the CPU side of a
+// frame, which is what the viewer pays before the GPU gets anything.
+void beginHeadless(float width, float height) {
+    ImGui::CreateContext();
+    ImPlot::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(width, height);
+    io.DeltaTime = 1.0f / 60.0f;
+    io.IniFilename = nullptr;
+    unsigned char* pixels;
+    int atlasWidth, atlasHeight;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &atlasWidth, &atlasHeight);
+}
+
+void endHeadless() {
+    ImPlot::DestroyContext();
+    ImGui::DestroyContext();
+}
+
+// The waveform plot of the viewer without the interaction, drawn by the
+// same calls: the line it falls back to without a framebuffer and the
+// batched markers
+static void drawWaveformPlot(const AudioProcessor& audio, size_t channel, double xMin, double xMax, float height,
+                             const MarkerStore& markers, AudioProcessor::WaveformData& waveform, MarkerBatch& batch) {
+    ImGui::PushID((int)channel);
+    if (ImPlot::BeginPlot("##Waveform", ImVec2(-1, height))) {
+        ImPlot::SetupAxes("Sample Number", "Amplitude");
+        ImPlot::SetupAxisLimits(ImAxis_X1, xMin, xMax, ImGuiCond_Always);
+        ImPlot::SetupAxisLimits(ImAxis_Y1, -1, 1, ImGuiCond_Always);
+
+        downsampleForPlot(audio, channel, waveform);
+        plotWaveformLine(waveform, ImPlot::GetColormapColor(0));
+
+        size_t minX = static_cast<size_t>(std::max(xMin, 0.0));
+        size_t maxX = static_cast<size_t>(std::max(std::ceil(xMax), 0.0)) + 1;
+        float plotWidth = std::max(ImPlot::GetPlotSize().x, 1.0f);
+        double samplesPerPixel = (xMax - xMin) / plotWidth;
+        buildMarkerBatch(markers, minX, maxX, samplesPerPixel, batch);
+        renderMarkerBatch(batch, samplesPerPixel);
+        ImPlot::EndPlot();
+    }
+    ImGui::PopID();
+}
+
+// CPU time per frame of the waveform plots and markers, panning a little
+// every frame so nothing is served from one frame to the next
+void benchFrame() {
+    const float width = 1920.0f, height = 1080.0f;
+    const size_t numChannels = 2;
+    const size_t minutes = benchQuick() ? 10 : 60;
+    const int numFrames = 300;
+
+    std::string path = syntheticWav(minutes, numChannels);
+    AudioProcessor audio;
+    if (path.empty() || !audio.loadWAV(path, AudioProcessor::LoadMode::Mapped)) {
+        printf("frame: cannot load synthetic WAV\n");
+        return;
+    }
+    size_t numSamples = audio.getNumSamples();
+
+    std::vector<size_t> counts = {10, 1000, 100000};
+    if (!benchQuick()) counts.push_back(1000000);
+    struct View {
+        const char* name;
+        double width;
+    };
+    const View views[] = {{"full", (double)numSamples}, {"1%", numSamples * 0.01}, {"samples", 2000.0}};
+
+    beginHeadless(width, height);
+    printf("frame: %zu min %zu channels, %.0fx%.0f, headless ImGui, %d frames\n",
+        minutes, numChannels, width, height, numFrames);
+    printf("%-8s %-8s %10s %10s %10s %10s\n", "markers", "view", "median ms", "p99 ms", "max ms", "vertices");
+    std::vector<AudioProcessor::WaveformData> waveforms(numChannels);
+    MarkerBatch batch;
+    for (size_t count : counts) {
+        MarkerStore markers;
+        markers.assign(syntheticMarkers(count, numSamples));
+        for (const View& view : views) {
+            std::vector<double> times;
+            int vertices = 0;
+            double start = (numSamples - view.width) / 2;
+            for (int frame = 0; frame < numFrames; ++frame) {
+                double xMin = std::max(0.0, start + (frame - numFrames / 2) * view.width * 0.002);
+                auto begin = std::chrono::steady_clock::now();
+                ImGui::NewFrame();
+                ImGui::SetNextWindowPos(ImVec2(0, 0));
+                ImGui::SetNextWindowSize(ImVec2(width, height));
+                ImGui::Begin("Audio Visualizer", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
+                float plotHeight = ImGui::GetContentRegionAvail().y * 0.6f / numChannels;
+                for (size_t c = 0; c < numChannels; ++c) {
+                    drawWaveformPlot(audio, c, xMin, xMin + view.width, plotHeight, markers, waveforms[c], batch);
+                }
+                ImGui::End();
+                ImGui::Render();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+                times.push_back(elapsed.count() * 1e3);
+                vertices = ImGui::GetDrawData()->TotalVtxCount;
+            }
+            // The first frames create the windows and plots
+            times.erase(times.begin(), times.begin() + 10);
+            double median = percentile(times, 0.5);
+            double p99 = percentile(times, 0.99);
+            double worst = percentile(times, 1.0);
+            printf("%-8zu %-8s %10.3f %10.3f %10.3f %10d\n", count, view.name, median, p99, worst, vertices);
+            std::string name = std::to_string(count) + "/" + view.name;
+            recordResult("frame", name, "median", median, "ms");
+            recordResult("frame", name, "p99", p99, "ms");
+        }
+    }
+    endHeadless();
+}
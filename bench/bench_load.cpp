@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "audio_processor.h"
+#include "markers.h"
+#include "sidecar.h"
+#include "wav_writer.h"
+#include <filesystem>
+#include <map>
+#include <random>
+#include <cmath>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+static constexpr size_t kSampleRate = 48000;
+
+std::string syntheticWav(size_t minutes, size_t numChannels) {
+    static std::map<std::pair<size_t, size_t>, std::string> written;
+    auto key = std::make_pair(minutes, numChannels);
+    auto found = written.find(key);
+    if (found != written.end()) return found->second;
+
+    char name[64];
+    snprintf(name, sizeof(name), "synthetic_%zumin_%zuch.wav", minutes, numChannels);
+    std::string path = (fs::path(benchScratchDir()) / name).string();
+    size_t numFrames = minutes * 60 * kSampleRate;
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return "";
+    bool ok = writeWAVHeader(out, SampleFormat::Int16, numChannels, kSampleRate, numFrames);
+
+    // Written a second at a time so 4 h files never sit in memory
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> noise(-300, 300);
+    std::vector<int16_t> chunk(kSampleRate * numChannels);
+    for (size_t start = 0; start < numFrames && ok; start += kSampleRate) {
+        size_t count = std::min(kSampleRate, numFrames - start);
+        for (size_t i = 0; i < count; ++i) {
+            double t = static_cast<double>(start + i) / kSampleRate;
+            double tone = 0.4 * std::sin(2 * M_PI * 220 * t) * (0.5 + 0.5 * std::sin(2 * M_PI * 0.3 * t));
+            for (size_t c = 0; c < numChannels; ++c) {
+                chunk[i * numChannels + c] = static_cast<int16_t>(tone * 32767 * (c + 1) / numChannels + noise(rng));
+            }
+        }
+        ok = fwrite(chunk.data(), sizeof(int16_t), count * numChannels, out) == count * numChannels;
+    }
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        printf("Cannot write %s\n", path.c_str());
+        fs::remove(path);
+        path.clear();
+    }
+    written[key] = path;
+    return path;
+}
+
+// Full load including the peak pyramid, per load mode. The files were just
+// written so this is warm page cache throughput, decode and peaks bound.
+void benchLoad() {
+    std::vector<size_t> durations = {1, 10};
+    if (!benchQuick()) {
+        durations.push_back(60);
+        durations.push_back(240);
+    }
+
+    printf("load: mono 16-bit %zu Hz, warm page cache\n", kSampleRate);
+    printf("%-8s %-16s %10s %10s\n", "minutes", "mode", "seconds", "MB/s");
+    for (size_t minutes : durations) {
+        std::string path = syntheticWav(minutes, 1);
+        if (path.empty()) continue;
+        std::error_code error;
+        double megabytes = fs::file_size(path, error) / 1e6;
+
+        struct Case {
+            const char* name;
+            AudioProcessor::LoadMode mode;
+            bool cached;
+        };
+        std::vector<Case> cases = {{"mapped", AudioProcessor::LoadMode::Mapped, false},
+                                   {"mapped+sidecar", AudioProcessor::LoadMode::Mapped, true}};
+        // Whole-file decode only up to the size the viewer would keep in memory
+        if (megabytes * 1e6 <= AudioProcessor::kMappedLoadThreshold * 4) {
+            cases.insert(cases.begin(), Case{"in-memory", AudioProcessor::LoadMode::InMemory, false});
+        }
+
+        // Peaks for the cached case come from a sidecar written by a plain load
+        std::string amkPath = sidecarPath(path);
+        {
+            AudioProcessor audio;
+            audio.loadWAV(path, AudioProcessor::LoadMode::Mapped);
+            SidecarFile::Content content;
+            stampFile(path, content.wav);
+            content.numSamples = audio.getNumSamples();
+            content.sampleRate = audio.getSampleRate();
+            content.numChannels = audio.getNumChannels();
+            const auto& levels = audio.getPeakLevels(0);
+            for (size_t l = 0; l < levels.size(); ++l) {
+                content.arrays.push_back({SidecarFile::kTagPeaks, 0, (uint16_t)l, levels[l].samplesPerBucket,
+                    levels[l].peaks.data(), levels[l].peaks.size()});
+            }
+            SidecarFile::write(amkPath, content);
+        }
+
+        for (const Case& c : cases) {
+            int repeats = minutes >= 60 ? 1 : 3;
+            double seconds = bestTime(repeats, [&] {
+                SidecarFile sidecar;
+                AudioProcessor audio;
+                const SidecarFile* cache = c.cached && sidecar.open(amkPath) ? &sidecar : nullptr;
+                audio.loadWAVAsync(path, c.mode, cache);
+                audio.waitUntilLoaded();
+            });
+            printf("%-8zu %-16s %10.3f %10.1f\n", minutes, c.name, seconds, megabytes / seconds);
+            std::string name = std::string(c.name) + "/" + std::to_string(minutes) + "min";
+            recordResult("load", name, "time", seconds, "s");
+            recordResult("load", name, "throughput", megabytes / seconds, "MB/s");
+        }
+        fs::remove(amkPath, error);
+    }
+}
@@ -0,0 +1,112 @@
+#include "bench.h"
+#include "pcm_decode.h"
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+struct Result {
+    std::string suite;
+    std::string name;
+    std::string metric;
+    double value;
+    const char* unit;
+};
+
+static std::vector<Result> results;
+static bool quick = false;
+static std::string scratchDir;
+
+bool benchQuick() {
+    return quick;
+}
+
+const std::string& benchScratchDir() {
+    return scratchDir;
+}
+
+void recordResult(const std::string& suite, const std::string& name, const std::string& metric,
+                  double value, const char* unit) {
+    results.push_back({suite, name, metric, value, unit});
+}
+
+// Names and units are plain ASCII picked by the benchmarks, only quotes and
+// backslashes need escaping
+static std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+static bool writeJson(const std::string& path) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        printf("Cannot write %s\n", path.c_str());
+        return false;
+    }
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n  \"timestamp\": \"%s\",\n  \"quick\": %s,\n", timestamp, quick ? "true" : "false");
+    fprintf(out, "  \"decodeKernel\": %s,\n  \"results\": [\n", jsonString(decodeKernelName()).c_str());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(out, "    {\"suite\": %s, \"name\": %s, \"metric\": %s, \"value\": %.6g, \"unit\": %s}%s\n",
+            jsonString(r.suite).c_str(), jsonString(r.name).c_str(), jsonString(r.metric).c_str(),
+            r.value, jsonString(r.unit).c_str(), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [--quick] [--json FILE] [suite...]\n", program);
+    printf("  suites: decode markers load csv edit frame resample (default: all)\n");
+    printf("  --quick      small inputs only, up to 10 min of audio and 100k markers\n");
+    printf("  --json FILE  also write every measurement to FILE as JSON\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::string jsonPath;
+    std::vector<std::string> suites;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            suites.push_back(argv[i]);
+        }
+    }
+    auto selected = [&](const char* suite) {
+        return suites.empty() || std::find(suites.begin(), suites.end(), suite) != suites.end();
+    };
+
+    std::error_code error;
+    scratchDir = (fs::temp_directory_path(error) / ("audiomarker_bench_" + std::to_string(getpid()))).string();
+    fs::create_directories(scratchDir, error);
+
+    if (selected("decode")) benchDecode();
+    if (selected("markers")) benchMarkers();
+    if (selected("load")) benchLoad();
+    if (selected("csv")) benchCsv();
+    if (selected("edit")) benchEdit();
+    if (selected("frame")) benchFrame();
+    if (selected("resample")) benchResample();
+
+    fs::remove_all(scratchDir, error);
+    return jsonPath.empty() || writeJson(jsonPath) ? 0 : 1;
+}
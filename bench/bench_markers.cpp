@@ -0,0 +1,105 @@
+#include "bench.h"
+#include "marker_batch.h"
+#include "marker_store.h"
+#include "waveform_plot.h"
+#include "imgui.h"
+#include "implot.h"
+#include <vector>
+#include <cstdio>
+#include <string>
+
+// The markers of one waveform plot the way the viewer drew them before the
+// batches: one PlotInfLines item per visible point and one DragRect per
+// visible section
+static void drawPerMarker(const MarkerStore& markers, size_t from, size_t to) {
+    markers.forEachPointIn(from, to, [&](size_t, const Marker& mark) {
+        double position = static_cast<double>(mark.sample);
+        ImPlot::PushStyleColor(ImPlotCol_Line, kIntensityColors[mark.intensity]);
+        ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
+        ImPlot::PlotInfLines("audio marks", &position, 1);
+        ImPlot::PopStyleColor();
+        ImPlot::PopStyleVar();
+    });
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    markers.forEachSectionIn(from, to, [&](size_t index, const Marker& mark) {
+        double start = static_cast<double>(mark.sample);
+        double end = static_cast<double>(mark.end);
+        ImPlot::DragRect(markers.sectionId(index), &start, &limits.Y.Min, &end, &limits.Y.Max,
+            ImVec4(1.0f, 0.0f, 0.0f, 0.5f));
+    });
+}
+
+// CPU time of headless ImGui frames holding one waveform-sized plot with
+// nothing but the markers, drawn one plot item per visible marker as before
+// against the intensity batches
+void benchMarkers() {
+    const size_t numSamples = 48000ull * 3600;  // one hour at 48 kHz
+    const float width = 1920.0f, height = 1080.0f;
+    const size_t counts[] = {1000, 100000};
+    const double zooms[] = {1.0, 0.01};
+    const int numFrames = benchQuick() ? 30 : 100;
+
+    beginHeadless(width, height);
+    printf("markers: %zu samples, %.0fx%.0f, headless ImGui, %d frames\n", numSamples, width, height, numFrames);
+    printf("%-8s %-6s %14s %10s %14s %10s %10s\n",
+        "markers", "view", "per-marker ms", "vertices", "batched ms", "vertices", "lines");
+    MarkerBatch batch;
+    for (size_t count : counts) {
+        MarkerStore markers;
+        markers.assign(syntheticMarkers(count, numSamples));
+
+        for (double zoom : zooms) {
+            double xMin = numSamples * (0.5 - zoom / 2);
+            double xMax = numSamples * (0.5 + zoom / 2);
+            size_t from = static_cast<size_t>(xMin);
+            size_t to = static_cast<size_t>(xMax);
+
+            // Median frame time and the vertices of the last frame
+            auto timeFrames = [&](bool batched, int& vertices) {
+                std::vector<double> times;
+                for (int frame = 0; frame < numFrames; ++frame) {
+                    auto begin = std::chrono::steady_clock::now();
+                    ImGui::NewFrame();
+                    ImGui::SetNextWindowPos(ImVec2(0, 0));
+                    ImGui::SetNextWindowSize(ImVec2(width, height));
+                    ImGui::Begin("Audio Visualizer", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
+                    if (ImPlot::BeginPlot("##Waveform", ImVec2(-1, height * 0.3f))) {
+                        ImPlot::SetupAxes("Sample Number", "Amplitude");
+                        ImPlot::SetupAxisLimits(ImAxis_X1, xMin, xMax, ImGuiCond_Always);
+                        ImPlot::SetupAxisLimits(ImAxis_Y1, -1, 1, ImGuiCond_Always);
+                        if (batched) {
+                            float plotWidth = std::max(ImPlot::GetPlotSize().x, 1.0f);
+                            double samplesPerPixel = (xMax - xMin) / plotWidth;
+                            buildMarkerBatch(markers, from, to, samplesPerPixel, batch);
+                            renderMarkerBatch(batch, samplesPerPixel);
+                        } else {
+                            drawPerMarker(markers, from, to);
+                        }
+                        ImPlot::EndPlot();
+                    }
+                    ImGui::End();
+                    ImGui::Render();
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+                    times.push_back(elapsed.count() * 1e3);
+                    vertices = ImGui::GetDrawData()->TotalVtxCount;
+                }
+                // The first frames create the window and the plot
+                times.erase(times.begin(), times.begin() + 2);
+                return percentile(times, 0.5);
+            };
+
+            int perMarkerVertices = 0, batchedVertices = 0;
+            double perMarker = timeFrames(false, perMarkerVertices);
+            double batched = timeFrames(true, batchedVertices);
+            size_t lines = 0;
+            for (int level = 0; level < MarkerBatch::kNumIntensities; ++level) lines += batch.lines[level].size();
+
+            printf("%-8zu %-6s %14.3f %10d %14.3f %10d %10zu\n", count, zoom == 1.0 ? "full" : "1%",
+                perMarker, perMarkerVertices, batched, batchedVertices, lines);
+            std::string name = std::to_string(count) + (zoom == 1.0 ? "/full" : "/1%");
+            recordResult("markers", name + "/per-marker", "median", perMarker, "ms");
+            recordResult("markers", name + "/batched", "median", batched, "ms");
+        }
+    }
+    endHeadless();
+}
@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "audio_processor.h"
+#include "resampler.h"
+#include "thread_pool.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+
+// Polyphase resampling throughput of a decoded file, one block at a time on
+// this thread and spread over a pool
+void benchResample() {
+    size_t minutes = benchQuick() ? 1 : 10;
+    std::string path = syntheticWav(minutes, 1);
+    if (path.empty()) return;
+    AudioProcessor audio;
+    if (!audio.loadWAV(path, AudioProcessor::LoadMode::InMemory)) return;
+    size_t numSamples = audio.getNumSamples();
+    const size_t targets[] = {44100, 96000, 16000};
+
+    ThreadPool pool;
+    printf("resample: %zu min mono from %zu Hz, kernel: %s, %zu threads\n",
+        minutes, audio.getSampleRate(), Resampler::kernelName(), pool.size());
+    printf("%-8s %6s %14s %14s\n", "target", "taps", "serial Ms/s", "parallel Ms/s");
+    for (size_t target : targets) {
+        Resampler resampler(audio.getSampleRate(), target);
+        size_t frames = resampler.toTarget(numSamples);
+        std::vector<float> out(frames), window;
+        double serial = bestTime(3, [&] {
+            for (size_t first = 0; first < frames; first += Resampler::kBlockFrames) {
+                size_t count = std::min(Resampler::kBlockFrames, frames - first);
+                resampler.process(audio, 0, first, count, out.data() + first, window);
+            }
+        });
+        double parallel = bestTime(3, [&] { resampler.processParallel(pool, audio, 0, 0, frames, out.data()); });
+        // Input samples per second
+        printf("%-8zu %6zu %14.1f %14.1f\n", target, resampler.getTaps(),
+            numSamples / serial / 1e6, numSamples / parallel / 1e6);
+        std::string name = std::to_string(target) + "Hz";
+        recordResult("resample", name + "/serial", "throughput", numSamples / serial / 1e6, "Msamples/s");
+        recordResult("resample", name + "/parallel", "throughput", numSamples / parallel / 1e6, "Msamples/s");
+    }
+}
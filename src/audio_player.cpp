@@ -0,0 +1,239 @@
+#include "audio_player.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool AudioPlayer::open(const AudioProcessor& source) {
+    close();
+    audio = &source;
+    sampleRate = source.getSampleRate();
+    // Stereo stays stereo, anything else is mixed down to mono
+    outputChannels = source.getNumChannels() == 2 ? 2 : 1;
+
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = static_cast<int>(sampleRate);
+    want.format = AUDIO_F32;
+    want.channels = static_cast<Uint8>(outputChannels);
+    want.samples = kDeviceFrames;
+    want.callback = audioCallback;
+    want.userdata = this;
+
+    // The device may keep its own rate, the feeder then converts with the
+    // polyphase filter instead of SDL's converter. Layout and format are
+    // still left to SDL.
+    device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0 || have.freq <= 0) {
+        printf("Failed to open audio device: %s\n", SDL_GetError());
+        if (device != 0) SDL_CloseAudioDevice(device);
+        device = 0;
+        audio = nullptr;
+        return false;
+    }
+    deviceRate = static_cast<size_t>(have.freq);
+    resampler = Resampler(sampleRate, deviceRate);
+    if (!resampler.isIdentity()) {
+        printf("Resampling %zu Hz to the device's %zu Hz\n", sampleRate, deviceRate);
+    }
+
+    planar.assign(kChunkFrames * source.getNumChannels(), 0.0f);
+    feedGeneration = generation.load();
+    feedPosition = resampler.toTarget(seekTarget.load());
+    stopFeeder = false;
+    feeder = std::thread([this] { feederLoop(); });
+    return true;
+}
+
+void AudioPlayer::close() {
+    if (device == 0) return;
+    // Closing waits for a running callback, the feeder goes after it
+    SDL_CloseAudioDevice(device);
+    device = 0;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopFeeder = true;
+    }
+    wake.notify_one();
+    feeder.join();
+    while (ring.beginRead()) ring.commitRead();
+    readOffset = 0;
+    playing = false;
+    audio = nullptr;
+    // The next file starts at its beginning without a loop, the new
+    // generation makes the playhead ignore the old clock
+    loopStart.store(0, std::memory_order_relaxed);
+    loopEnd.store(0, std::memory_order_relaxed);
+    seekTarget.store(0, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+void AudioPlayer::play() {
+    if (device == 0) return;
+    SDL_PauseAudioDevice(device, 0);
+    playing = true;
+}
+
+void AudioPlayer::pause() {
+    if (device == 0) return;
+    SDL_PauseAudioDevice(device, 1);
+    playing = false;
+}
+
+void AudioPlayer::seek(size_t sample) {
+    seekTarget.store(sample, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    wake.notify_one();
+}
+
+void AudioPlayer::setLoop(size_t start, size_t end) {
+    loopStart.store(start, std::memory_order_relaxed);
+    loopEnd.store(end > start ? end : 0, std::memory_order_relaxed);
+}
+
+double AudioPlayer::getPlayhead() const {
+    uint32_t seq, gen;
+    size_t frame, frames;
+    int64_t time;
+    do {
+        seq = clockSeq.load(std::memory_order_acquire);
+        gen = clockGeneration.load(std::memory_order_relaxed);
+        frame = clockFrame.load(std::memory_order_relaxed);
+        frames = clockFrames.load(std::memory_order_relaxed);
+        time = clockTime.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != clockSeq.load(std::memory_order_relaxed));
+
+    // Nothing played since the last seek yet
+    if (gen != generation.load(std::memory_order_acquire)) {
+        return static_cast<double>(seekTarget.load(std::memory_order_relaxed));
+    }
+    double elapsed = playing && deviceRate > 0 ? (nowNanoseconds() - time) * 1e-9 * deviceRate : 0.0;
+    double played = frame + std::min(std::max(elapsed, 0.0), static_cast<double>(frames));
+    return resampler.isIdentity() ? played : played * sampleRate / deviceRate;
+}
+
+void AudioPlayer::audioCallback(void* userdata, Uint8* stream, int len) {
+    AudioPlayer* player = static_cast<AudioPlayer*>(userdata);
+    player->fillBuffer(reinterpret_cast<float*>(stream), len / (sizeof(float) * player->outputChannels));
+}
+
+void AudioPlayer::fillBuffer(float* out, size_t frames) {
+    // Audio thread: no allocation, no locks, no waiting
+    uint32_t current = generation.load(std::memory_order_acquire);
+    size_t filled = 0;
+    bool positioned = false;
+    size_t firstFrame = 0;
+    while (filled < frames) {
+        const Chunk* chunk = ring.beginRead();
+        if (!chunk) break;
+        // Chunks fed before the last seek are dropped unheard
+        if (static_cast<int32_t>(chunk->generation - current) < 0) {
+            ring.commitRead();
+            readOffset = 0;
+            continue;
+        }
+        if (!positioned) {
+            firstFrame = chunk->firstFrame + readOffset;
+            positioned = true;
+        }
+        size_t count = std::min(chunk->frames - readOffset, frames - filled);
+        memcpy(out + filled * outputChannels, chunk->samples + readOffset * outputChannels,
+               count * outputChannels * sizeof(float));
+        filled += count;
+        readOffset += count;
+        if (readOffset == chunk->frames) {
+            ring.commitRead();
+            readOffset = 0;
+        }
+    }
+    // Underruns and the end of the file play silence
+    memset(out + filled * outputChannels, 0, (frames - filled) * outputChannels * sizeof(float));
+
+    if (positioned) {
+        uint32_t seq = clockSeq.load(std::memory_order_relaxed);
+        clockSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        clockGeneration.store(current, std::memory_order_relaxed);
+        clockFrame.store(firstFrame, std::memory_order_relaxed);
+        clockFrames.store(filled, std::memory_order_relaxed);
+        clockTime.store(nowNanoseconds(), std::memory_order_relaxed);
+        clockSeq.store(seq + 2, std::memory_order_release);
+    }
+}
+
+void AudioPlayer::feederLoop() {
+    profilerSetThreadName("audio feeder");
+    while (!stopFeeder) {
+        uint32_t current = generation.load(std::memory_order_acquire);
+        if (current != feedGeneration) {
+            feedGeneration = current;
+            feedPosition = resampler.toTarget(seekTarget.load(std::memory_order_relaxed));
+        }
+
+        Chunk* chunk = ring.beginWrite();
+        if (chunk && fillChunk(*chunk)) {
+            ring.commitWrite();
+            continue;
+        }
+        // Ring full, end of file or waiting for the loader: check again
+        // shortly, or right away when a seek comes in
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::milliseconds(5), [this] {
+            return stopFeeder || generation.load(std::memory_order_relaxed) != feedGeneration;
+        });
+    }
+}
+
+bool AudioPlayer::fillChunk(Chunk& chunk) {
+    // Loop points are source samples, they map to the same device frames
+    // every time so loops stay sample accurate
+    size_t start = resampler.toTarget(loopStart.load(std::memory_order_relaxed));
+    size_t end = resampler.toTarget(loopEnd.load(std::memory_order_relaxed));
+    bool looping = end > start;
+    // Chunks stop at the loop end, landing exactly on it means we played
+    // through, a seek past the loop just plays on
+    if (looping && feedPosition == end) {
+        feedPosition = start;
+    }
+    size_t numSamples = audio->getNumSamples();
+    size_t loaded = audio->getLoadedSamples();
+    size_t stop = looping && feedPosition < end ? end : resampler.toTarget(numSamples);
+    // A frame still being loaded waits until the filter has all its input
+    stop = std::min(stop, loaded == numSamples ? resampler.toTarget(loaded) : resampler.readyFrames(loaded));
+    if (feedPosition >= stop) return false;
+
+    size_t frames = std::min(kChunkFrames, stop - feedPosition);
+    size_t numChannels = audio->getNumChannels();
+    for (size_t c = 0; c < numChannels; ++c) {
+        resampler.process(*audio, c, feedPosition, frames, planar.data() + c * kChunkFrames, window);
+    }
+
+    if (outputChannels == 2) {
+        const float* left = planar.data();
+        const float* right = planar.data() + kChunkFrames;
+        for (size_t i = 0; i < frames; ++i) {
+            chunk.samples[i * 2] = left[i];
+            chunk.samples[i * 2 + 1] = right[i];
+        }
+    } else {
+        float scale = 1.0f / numChannels;
+        for (size_t i = 0; i < frames; ++i) {
+            float sum = 0.0f;
+            for (size_t c = 0; c < numChannels; ++c) sum += planar[c * kChunkFrames + i];
+            chunk.samples[i] = sum * scale;
+        }
+    }
+
+    chunk.generation = feedGeneration;
+    chunk.firstFrame = feedPosition;
+    chunk.frames = frames;
+    feedPosition += frames;
+    return true;
+}
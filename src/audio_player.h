@@ -0,0 +1,103 @@
+#pragma once
+#include "audio_processor.h"
+#include "resampler.h"
+#include "spsc_ring.h"
+#include <SDL.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+
+// Callback-driven playback of an AudioProcessor.
+//
+// A feeder thread reads samples, mixes them to the output layout and pushes
+// fixed-size chunks into an SPSC ring, the SDL callback only copies chunks
+// out of it. Seeks bump a generation number instead of clearing the ring,
+// the callback drops chunks of older generations, so the audio thread never
+// allocates, locks or waits on the UI. When the device runs at another rate
+// than the file the feeder resamples, positions it hands around are device
+// frames and the playhead maps them back to source samples.
+class AudioPlayer {
+public:
+    static constexpr size_t kChunkFrames = 512;
+    // About 0.7 s at 48 kHz buffered ahead of the device
+    static constexpr size_t kRingChunks = 64;
+    static constexpr uint16_t kDeviceFrames = 1024;
+    static constexpr size_t kMaxOutputChannels = 2;
+
+    AudioPlayer() : ring(kRingChunks) {}
+    ~AudioPlayer() { close(); }
+    AudioPlayer(const AudioPlayer&) = delete;
+    AudioPlayer& operator=(const AudioPlayer&) = delete;
+
+    // Opens a paused device, at the source sample rate when the hardware
+    // allows it, and starts the feeder. audio must stay alive until close(),
+    // its header has to be parsed.
+    bool open(const AudioProcessor& audio);
+    // Also forgets the position and the loop, the next open() starts at 0
+    void close();
+    bool isOpen() const { return device != 0; }
+
+    void play();
+    void pause();
+    bool isPlaying() const { return playing; }
+    // Continues from sample, keeps the play/pause state
+    void seek(size_t sample);
+    // Jumps back to start whenever playback reaches end, end 0 stops looping
+    void setLoop(size_t start, size_t end);
+    bool isLooping() const { return loopEnd.load(std::memory_order_relaxed) != 0; }
+
+    // Source sample being heard now, from the last callback plus the time since
+    double getPlayhead() const;
+
+private:
+    struct Chunk {
+        uint32_t generation;
+        size_t firstFrame;
+        size_t frames;
+        float samples[kChunkFrames * kMaxOutputChannels];
+    };
+
+    static void audioCallback(void* userdata, Uint8* stream, int len);
+    void fillBuffer(float* out, size_t frames);
+    void feederLoop();
+    bool fillChunk(Chunk& chunk);
+
+    const AudioProcessor* audio = nullptr;
+    SDL_AudioDeviceID device = 0;
+    size_t outputChannels = 1;
+    size_t sampleRate = 0;
+    size_t deviceRate = 0;
+    // Source to device rate, identity when they match
+    Resampler resampler;
+    bool playing = false;
+
+    SpscRing<Chunk> ring;
+    // Frames of the ring's front chunk already played, audio thread only
+    size_t readOffset = 0;
+
+    // UI to feeder and callback: a seek stores the target then bumps the generation
+    std::atomic<size_t> seekTarget{0};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<size_t> loopStart{0};
+    std::atomic<size_t> loopEnd{0};
+
+    // Feeder state, owned by the feeder thread. feedPosition is in device frames.
+    std::thread feeder;
+    std::atomic<bool> stopFeeder{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    uint32_t feedGeneration = 0;
+    size_t feedPosition = 0;
+    std::vector<float> planar;
+    std::vector<float> window;
+
+    // Callback to UI, a seqlock so the three fields are read together
+    std::atomic<uint32_t> clockSeq{0};
+    std::atomic<uint32_t> clockGeneration{0};
+    std::atomic<size_t> clockFrame{0};
+    std::atomic<size_t> clockFrames{0};
+    std::atomic<int64_t> clockTime{0};
+};
@@ -1,55 +1,493 @@
 #include "audio_processor.h"
-#include <fstream>
+#include "sidecar.h"
+#include "profiler.h"
 #include <algorithm>
 #include <cstring>
+#include <utility>
+#include <cstdio>
 
-bool AudioProcessor::loadWAV(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) return false;
+// WAVE format tags
+static constexpr uint16_t kFormatPCM = 1;
+static constexpr uint16_t kFormatFloat = 3;
+static constexpr uint16_t kFormatExtensible = 0xFFFE;
 
-    WAVHeader header;
-    file.read(reinterpret_cast<char*>(&header), sizeof(WAVHeader));
+// Wave64 chunk IDs are GUIDs, the first four bytes spell the RIFF name
+static const uint8_t kW64Riff[16] = {'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t kW64Wave[16] = {'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t kW64Fmt[16] = {'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t kW64Data[16] = {'d', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
 
-    // Verify RIFF header
-    if (strncmp(header.riff, "RIFF", 4) != 0 || 
-        strncmp(header.wave, "WAVE", 4) != 0) {
+// Loads so far, each gets its own range of block keys
+static std::atomic<uint64_t> nextBlockKeyBase{0};
+
+AudioProcessor::~AudioProcessor() {
+    stopLoading();
+}
+
+void AudioProcessor::shareBlockCache(std::shared_ptr<BlockCache> cache) {
+    blockCache = std::move(cache);
+    sharedBlockCache = true;
+}
+
+size_t AudioProcessor::getMemoryBytes() const {
+    size_t bytes = sharedBlockCache ? 0 : blockCache->getUsedBytes();
+    for (const auto& channel : channels) bytes += channel.capacity() * sizeof(float);
+    for (const auto& levels : peakLevels) {
+        for (const auto& level : levels) bytes += level.peaks.capacity() * sizeof(float);
+    }
+    return bytes;
+}
+
+bool AudioProcessor::loadWAV(const std::string& filename, LoadMode mode) {
+    if (!openWAV(filename, mode)) return false;
+    if (mode != LoadMode::Raw) decodeAll();
+    return true;
+}
+
+bool AudioProcessor::loadWAVAsync(const std::string& filename, LoadMode mode, const SidecarFile* cache) {
+    if (!openWAV(filename, mode, cache)) return false;
+    if (isLoaded()) return true;
+    loader = std::thread([this] {
+        profilerSetThreadName("loader");
+        decodeAll();
+    });
+    return true;
+}
+
+void AudioProcessor::stopLoading() {
+    cancelLoad = true;
+    if (loader.joinable()) {
+        loader.join();
+    }
+    cancelLoad = false;
+}
+
+void AudioProcessor::waitUntilLoaded() {
+    if (loader.joinable()) {
+        loader.join();
+    }
+}
+
+float AudioProcessor::getLoadProgress() const {
+    if (numSamples == 0) return 1.0f;
+    return static_cast<float>(getLoadedSamples()) / numSamples;
+}
+
+bool AudioProcessor::openWAV(const std::string& filename, LoadMode mode, const SidecarFile* cache) {
+    PROFILE_SCOPE("open wav");
+    stopLoading();
+    channels.clear();
+    peakLevels.clear();
+    peaksCached = false;
+    if (!sharedBlockCache) blockCache->clear();
+    blockKeyBase = nextBlockKeyBase.fetch_add(1) << 40;
+    numSamples = 0;
+    numChannels = 0;
+    loadedSamples.store(0, std::memory_order_relaxed);
+    tailing = mode == LoadMode::Tail;
+
+    if (!file.open(filename, tailing ? kTailReserveBytes : 0)) return false;
+    if (!parseWAV() || numSamples == 0) {
+        file.close();
         return false;
     }
 
-    // Check if the file is stereo
-    if (header.numChannels != 1) {
-        // Stereo file detected, return false or handle error
+    if (mode == LoadMode::Auto) {
+        mode = file.size() > kMappedLoadThreshold ? LoadMode::Mapped : LoadMode::InMemory;
+    }
+    // A growing file can't be held in fixed buffers, it is always mapped
+    mapped = mode == LoadMode::Mapped || mode == LoadMode::Raw || mode == LoadMode::Tail;
+    if (mode == LoadMode::Raw) {
+        // Nothing to load, every sample is readable through the blocks
+        peakLevels.assign(numChannels, {});
+        levelsReady.clear();
+        loadedSamples.store(numSamples, std::memory_order_release);
+        return true;
+    }
+    file.adviseSequential();
+
+    // Every buffer gets its final size now, the loader thread only fills them
+    // in so readers never see a reallocation
+    if (!mapped) {
+        channels.resize(numChannels);
+        for (auto& channel : channels) {
+            channel.resize(numSamples);
+        }
+    }
+    allocatePeakLevels();
+    peaksCached = cache && loadCachedPeaks(filename, *cache);
+    if (peaksCached && mapped) {
+        // Blocks are decoded on demand anyway, the peaks were all the loader made
+        loadedSamples.store(numSamples, std::memory_order_release);
+    }
+    return true;
+}
+
+bool AudioProcessor::loadCachedPeaks(const std::string& filename, const SidecarFile& cache) {
+    if (!cache.matchesWav(filename) || cache.getNumSamples() != numSamples ||
+            cache.getNumChannels() != numChannels || cache.getSampleRate() != sampleRate) {
         return false;
     }
+    // The pyramid has to have exactly the shape this build would compute
+    for (size_t c = 0; c < numChannels; ++c) {
+        for (size_t l = 0; l < peakLevels[c].size(); ++l) {
+            PeakLevel& level = peakLevels[c][l];
+            uint64_t samplesPerBucket = 0;
+            size_t count = 0;
+            const float* peaks = cache.findArray(SidecarFile::kTagPeaks, c, l, samplesPerBucket, count);
+            if (!peaks || samplesPerBucket != level.samplesPerBucket || count != level.peaks.size()) {
+                return false;
+            }
+            std::copy(peaks, peaks + count, level.peaks.begin());
+        }
+    }
+    for (size_t l = 0; l < levelsReady.size(); ++l) {
+        levelsReady[l] = peakLevels[0][l].peaks.size() / 2;
+    }
+    return true;
+}
+
+void AudioProcessor::decodeAll() {
+    // Source pages are dropped as soon as a block is decoded to keep RSS flat.
+    // In mapped mode only the peaks are kept, blocks are decoded again on demand.
+    size_t frameBytes = sampleBytes * numChannels;
+    std::vector<float> scratch(mapped ? kBlockSamples * numChannels : 0);
+    std::vector<float*> planes(numChannels);
+    // Picks up after the frames decoded before a tailed file grew
+    for (size_t start = getLoadedSamples(); start < numSamples && !cancelLoad; start += kBlockSamples) {
+        PROFILE_SCOPE("decode block");
+        size_t count = std::min(kBlockSamples, numSamples - start);
+        for (size_t c = 0; c < numChannels; ++c) {
+            planes[c] = mapped ? scratch.data() + c * count : channels[c].data() + start;
+        }
+        decodePCMPlanar(sampleFormat, file.data() + dataOffset + start * frameBytes, numChannels, planes.data(), count);
+        size_t ready = start + count;
+        if (!peaksCached) {
+            for (size_t c = 0; c < numChannels; ++c) {
+                appendBasePeaks(c, start, SampleView(planes[c], count));
+            }
+            updatePeakLevels(ready);
+        }
+        file.release(dataOffset + start * frameBytes, count * frameBytes);
+        // Publishes the samples and peaks written above to reader threads
+        loadedSamples.store(ready, std::memory_order_release);
+    }
 
-    // Skip to data chunk
-    char chunkID[4];
-    uint32_t chunkSize;
-    while (file.read(chunkID, 4)) {
-        file.read(reinterpret_cast<char*>(&chunkSize), 4);
-        if (strncmp(chunkID, "data", 4) == 0) {
+    if (!mapped && !cancelLoad) {
+        file.close();
+    }
+}
+
+bool AudioProcessor::parseWAV() {
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+    if (size < 12) return false;
+
+    // RIFF, its 64-bit forms RF64 and BW64 which keep the real sizes in a
+    // ds64 chunk, or Sony Wave64 with GUID chunk IDs and 64-bit sizes
+    bool wave64 = size >= 40 && memcmp(data, kW64Riff, 16) == 0 && memcmp(data + 24, kW64Wave, 16) == 0;
+    bool rf64 = (memcmp(data, "RF64", 4) == 0 || memcmp(data, "BW64", 4) == 0) && memcmp(data + 8, "WAVE", 4) == 0;
+    if (!wave64 && !rf64) {
+        memcpy(&header, data, 12);
+        if (strncmp(header.riff, "RIFF", 4) != 0 ||
+            strncmp(header.wave, "WAVE", 4) != 0) {
+            return false;
+        }
+    }
+    auto isChunk = [wave64](const uint8_t* id, const char* name, const uint8_t* guid) {
+        return wave64 ? memcmp(id, guid, 16) == 0 : memcmp(id, name, 4) == 0;
+    };
+
+    // Walk the chunks in place, the fmt chunk fills the rest of the header
+    bool hasFormat = false;
+    uint16_t formatTag = 0;
+    size_t chunkHeaderBytes = wave64 ? 24 : 8;
+    size_t pos = wave64 ? 40 : 12;
+    size_t ds64Pos = 0;
+    dataOffset = 0;
+    while (pos + chunkHeaderBytes <= size) {
+        const uint8_t* chunk = data + pos;
+        size_t bodyPos = pos + chunkHeaderBytes;
+        uint64_t chunkSize;
+        if (wave64) {
+            memcpy(&chunkSize, chunk + 16, 8);
+            if (chunkSize < 24) return false;
+            chunkSize -= 24;
+        } else {
+            uint32_t size32;
+            memcpy(&size32, chunk + 4, 4);
+            chunkSize = size32;
+        }
+
+        if (rf64 && memcmp(chunk, "ds64", 4) == 0 && bodyPos + 16 <= size) {
+            // RIFF size, then data size
+            ds64Pos = bodyPos + 8;
+        } else if (isChunk(chunk, "fmt ", kW64Fmt) && bodyPos + 16 <= size) {
+            memcpy(&header.audioFormat, data + bodyPos, 16);
+            formatTag = header.audioFormat;
+            // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of its sub-format GUID
+            if (formatTag == kFormatExtensible && chunkSize >= 40 && bodyPos + 26 <= size) {
+                memcpy(&formatTag, data + bodyPos + 24, 2);
+            }
+            hasFormat = true;
+        } else if (isChunk(chunk, "data", kW64Data)) {
+            dataOffset = bodyPos;
+            dataSizePos = wave64 ? pos + 16 : pos + 4;
+            dataSizeBytes = wave64 ? 8 : 4;
+            dataSizeBias = wave64 ? 24 : 0;
+            if (rf64 && chunkSize == 0xFFFFFFFFu && ds64Pos != 0) {
+                dataSizePos = ds64Pos;
+                dataSizeBytes = 8;
+            }
             break;
         }
-        file.seekg(chunkSize, std::ios::cur);
+        if (chunkSize > size) break;
+        // RIFF chunks are padded to an even size, Wave64 ones to a multiple of 8
+        size_t align = wave64 ? 8 : 2;
+        pos = (bodyPos + chunkSize + align - 1) / align * align;
+    }
+    if (!hasFormat || dataOffset == 0) return false;
+
+    if (header.numChannels == 0) {
+        return false;
+    }
+
+    if (formatTag == kFormatPCM && header.bitsPerSample == 8) {
+        sampleFormat = SampleFormat::UInt8;
+    } else if (formatTag == kFormatPCM && header.bitsPerSample == 16) {
+        sampleFormat = SampleFormat::Int16;
+    } else if (formatTag == kFormatPCM && header.bitsPerSample == 24) {
+        sampleFormat = SampleFormat::Int24;
+    } else if (formatTag == kFormatPCM && header.bitsPerSample == 32) {
+        sampleFormat = SampleFormat::Int32;
+    } else if (formatTag == kFormatFloat && header.bitsPerSample == 32) {
+        sampleFormat = SampleFormat::Float32;
+    } else if (formatTag == kFormatFloat && header.bitsPerSample == 64) {
+        sampleFormat = SampleFormat::Float64;
+    } else {
+        printf("Unsupported WAV encoding: format %u, %u bits\n", formatTag, header.bitsPerSample);
+        return false;
     }
 
-    // Read samples
-    samples.clear();
     sampleRate = header.sampleRate;
-    size_t numSamples = chunkSize / (header.bitsPerSample / 8);
-    samples.reserve(numSamples);
+    sampleBytes = bytesPerSample(sampleFormat);
+    numChannels = header.numChannels;
+    numSamples = dataFrames();
+    return true;
+}
 
-    if (header.bitsPerSample == 16) {
-        int16_t sample;
-        while (file.read(reinterpret_cast<char*>(&sample), sizeof(sample))) {
-            samples.push_back(sample / 32768.0f);
+size_t AudioProcessor::dataFrames() const {
+    uint64_t declared = 0;
+    if (dataSizePos + dataSizeBytes <= file.size()) {
+        if (dataSizeBytes == 8) {
+            memcpy(&declared, file.data() + dataSizePos, 8);
+        } else {
+            uint32_t size32;
+            memcpy(&size32, file.data() + dataSizePos, 4);
+            declared = size32;
         }
-    } else if (header.bitsPerSample == 32) {
-        float sample;
-        while (file.read(reinterpret_cast<char*>(&sample), sizeof(sample))) {
-            samples.push_back(sample);
+    }
+    declared = declared > dataSizeBias ? declared - dataSizeBias : 0;
+    // Truncated recordings announce more data than they hold. Recorders that
+    // patch the header when they close the file leave 0 or a placeholder
+    // until then, the data runs to the end of the file.
+    size_t available = file.size() - dataOffset;
+    size_t bytes = declared == 0 || declared > available ? available : static_cast<size_t>(declared);
+    return bytes / (sampleBytes * numChannels);
+}
+
+bool AudioProcessor::pollTail() {
+    // The loader owns the peaks until it has caught up
+    if (!tailing || getLoadedSamples() < numSamples) return false;
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextTailPoll) return false;
+    nextTailPoll = now + std::chrono::milliseconds(kTailPollMs);
+
+    waitUntilLoaded();
+    file.refreshSize();
+    size_t oldSamples = numSamples;
+    size_t frames = dataFrames();
+    if (file.size() == file.capacity()) {
+        printf("Reserved address space is full, no longer following the file\n");
+        tailing = false;
+    }
+    if (frames <= oldSamples) return false;
+
+    // The last partial block is decoded again and the buckets it fed are
+    // rebuilt. Readers stop at the lowered watermark so they never see them
+    // change, and the mapping doesn't move under them.
+    size_t resume = oldSamples / kBlockSamples * kBlockSamples;
+    loadedSamples.store(resume, std::memory_order_release);
+    numSamples = frames;
+    peaksCached = false;
+    size_t oldLevels = levelsReady.size();
+    allocatePeakLevels();
+    for (size_t l = 0; l < oldLevels; ++l) {
+        levelsReady[l] = std::min(levelsReady[l], resume / peakLevels[0][l].samplesPerBucket);
+    }
+    // Levels the longer file added are filled up to the watermark before
+    // anyone reads them
+    updatePeakLevels(resume);
+    loader = std::thread([this] {
+        profilerSetThreadName("loader");
+        decodeAll();
+    });
+    return true;
+}
+
+BlockCache::Block AudioProcessor::decodedBlock(size_t blockIndex) const {
+    size_t start = blockIndex * kBlockSamples;
+    size_t count = std::min(kBlockSamples, numSamples - start);
+    BlockCache::Block block = blockCache->get(blockKeyBase + blockIndex);
+    // The last block of a tailed file is decoded again once the file grew
+    if (block && block->size() == count * numChannels) return block;
+    PROFILE_SCOPE("decode block");
+
+    auto decoded = std::make_shared<std::vector<float>>(count * numChannels);
+    std::vector<float*> planes(numChannels);
+    for (size_t c = 0; c < numChannels; ++c) planes[c] = decoded->data() + c * count;
+    const uint8_t* src = file.data() + dataOffset + start * sampleBytes * numChannels;
+    decodePCMPlanar(sampleFormat, src, numChannels, planes.data(), count);
+    blockCache->put(blockKeyBase + blockIndex, decoded);
+    return decoded;
+}
+
+const uint8_t* AudioProcessor::getRawFrames(size_t startSample) const {
+    if (!file.isOpen() || startSample > numSamples) return nullptr;
+    return file.data() + dataOffset + startSample * getFrameBytes();
+}
+
+SampleView AudioProcessor::getSamples(size_t channel) const {
+    if (channel >= channels.size()) return SampleView();
+    return SampleView(channels[channel]);
+}
+
+size_t AudioProcessor::readSamples(size_t channel, size_t startSample, size_t count, float* out) const {
+    size_t copied = 0;
+    forEachBlock(channel, startSample, startSample + count, [&](SampleView piece, size_t) {
+        std::copy(piece.begin(), piece.end(), out + copied);
+        copied += piece.size();
+    });
+    return copied;
+}
+
+void AudioProcessor::allocatePeakLevels() {
+    // Every coarser level folds kPeakLevelFactor buckets of the previous one,
+    // until the whole file fits in a handful of screen widths. A tailed file
+    // that grew keeps its levels and gains buckets and levels at the end.
+    peakLevels.resize(numChannels);
+    size_t samplesPerBucket = kPeakBaseBucket;
+    size_t numBuckets = (numSamples + kPeakBaseBucket - 1) / kPeakBaseBucket;
+    size_t numLevels = 0;
+    while (true) {
+        for (auto& levels : peakLevels) {
+            if (levels.size() == numLevels) levels.push_back(PeakLevel{samplesPerBucket, {}});
+            levels[numLevels].peaks.resize(numBuckets * 2);
         }
+        numLevels++;
+        if (numBuckets <= 4096) break;
+        samplesPerBucket *= kPeakLevelFactor;
+        numBuckets = (numBuckets + kPeakLevelFactor - 1) / kPeakLevelFactor;
     }
+    levelsReady.resize(numLevels, 0);
+}
 
-    return !samples.empty();
+void AudioProcessor::appendBasePeaks(size_t channel, size_t firstSample, SampleView chunk) {
+    // Chunks start on a bucket boundary, only the last one may be partial
+    float* peaks = peakLevels[channel][0].peaks.data() + firstSample / kPeakBaseBucket * 2;
+    for (size_t begin = 0; begin < chunk.size(); begin += kPeakBaseBucket) {
+        size_t end = std::min(begin + kPeakBaseBucket, chunk.size());
+        float lo = chunk[begin];
+        float hi = chunk[begin];
+        for (size_t i = begin + 1; i < end; ++i) {
+            lo = std::min(lo, chunk[i]);
+            hi = std::max(hi, chunk[i]);
+        }
+        *peaks++ = lo;
+        *peaks++ = hi;
+    }
+}
+
+void AudioProcessor::updatePeakLevels(size_t readySamples) {
+    bool complete = readySamples == numSamples;
+    std::vector<PeakLevel>& shape = peakLevels[0];
+    levelsReady[0] = complete ? shape[0].peaks.size() / 2 : readySamples / kPeakBaseBucket;
+
+    // Fold the finer level's finished buckets into the next one, the last
+    // partial bucket only once the whole file is in
+    for (size_t l = 1; l < shape.size(); ++l) {
+        size_t prevBuckets = levelsReady[l - 1];
+        size_t target = complete ? shape[l].peaks.size() / 2 : prevBuckets / kPeakLevelFactor;
+        for (auto& levels : peakLevels) {
+            const std::vector<float>& prev = levels[l - 1].peaks;
+            std::vector<float>& next = levels[l].peaks;
+            for (size_t b = levelsReady[l]; b < target; ++b) {
+                size_t begin = b * kPeakLevelFactor;
+                size_t end = std::min(begin + kPeakLevelFactor, prevBuckets);
+                float lo = prev[begin * 2];
+                float hi = prev[begin * 2 + 1];
+                for (size_t i = begin + 1; i < end; ++i) {
+                    lo = std::min(lo, prev[i * 2]);
+                    hi = std::max(hi, prev[i * 2 + 1]);
+                }
+                next[b * 2] = lo;
+                next[b * 2 + 1] = hi;
+            }
+        }
+        levelsReady[l] = target;
+    }
+}
+
+void AudioProcessor::getDownsampledData(size_t channel, size_t startSample, size_t endSample, size_t maxPoints, WaveformData& out) const {
+    out.values.clear();
+    out.firstSample = startSample;
+    out.samplesPerBucket = 1;
+    // Only what the loader has published so far
+    size_t loaded = getLoadedSamples();
+    endSample = std::min(endSample, loaded);
+    if (startSample >= endSample || maxPoints < 4 || channel >= numChannels) return;
+
+    // Zoomed in enough to draw every sample
+    const std::vector<PeakLevel>& levels = peakLevels[channel];
+    size_t count = endSample - startSample;
+    if (count <= maxPoints || levels.empty()) {
+        out.values.resize(count);
+        readSamples(channel, startSample, count, out.values.data());
+        return;
+    }
+
+    // Pick the finest level that fits, two points (min, max) per bucket
+    const PeakLevel* level = &levels.back();
+    for (const auto& candidate : levels) {
+        size_t buckets = count / candidate.samplesPerBucket + 2;
+        if (buckets * 2 <= maxPoints) {
+            level = &candidate;
+            break;
+        }
+    }
+
+    size_t levelBuckets = loaded == numSamples ? level->peaks.size() / 2 : loaded / level->samplesPerBucket;
+    size_t firstBucket = startSample / level->samplesPerBucket;
+    size_t lastBucket = std::min((endSample - 1) / level->samplesPerBucket + 1, levelBuckets);
+
+    // The coarsest level may still be too dense, merge its buckets on the fly.
+    // One spare pair is kept for the group alignment below.
+    size_t group = ((lastBucket - firstBucket) * 2 + maxPoints - 3) / (maxPoints - 2);
+    group = std::max<size_t>(group, 1);
+    firstBucket -= firstBucket % group;
+
+    out.firstSample = firstBucket * level->samplesPerBucket;
+    out.samplesPerBucket = level->samplesPerBucket * group;
+    out.values.reserve(((lastBucket - firstBucket) / group + 1) * 2);
+    for (size_t b = firstBucket; b < lastBucket; b += group) {
+        size_t end = std::min(b + group, lastBucket);
+        float lo = level->peaks[b * 2];
+        float hi = level->peaks[b * 2 + 1];
+        for (size_t i = b + 1; i < end; ++i) {
+            lo = std::min(lo, level->peaks[i * 2]);
+            hi = std::max(hi, level->peaks[i * 2 + 1]);
+        }
+        out.values.push_back(lo);
+        out.values.push_back(hi);
+    }
 }
\ No newline at end of file
@@ -2,6 +2,17 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include "sample_view.h"
+#include "mapped_file.h"
+#include "block_cache.h"
+#include "pcm_decode.h"
+
+class SidecarFile;
 
 class AudioProcessor {
 public:
@@ -19,13 +30,158 @@ public:
         uint16_t bitsPerSample;
     };
 
-    bool loadWAV(const std::string& filename);
-    const std::vector<float>& getSamples() const { return samples; }
-    std::vector<float> getDownsampledData(size_t maxPoints) const;
+    // Min/max summary of the waveform, one pair per bucket of samples
+    struct PeakLevel {
+        size_t samplesPerBucket;
+        std::vector<float> peaks; // interleaved min, max
+    };
+
+    // Plot-ready waveform points. When samplesPerBucket is 1 values holds raw
+    // samples, otherwise it holds interleaved min/max pairs, one per bucket.
+    struct WaveformData {
+        std::vector<float> values;
+        size_t firstSample = 0;
+        size_t samplesPerBucket = 1;
+    };
+
+    enum class LoadMode {
+        InMemory, // decode the whole file up front
+        Mapped,   // mmap the file and decode blocks on demand
+        Auto,     // Mapped for files above kMappedLoadThreshold
+        Raw,      // mmap and parse only, no peaks are built and blocks are
+                  // decoded on demand, for tools reading a few ranges
+        Tail      // Mapped, for a file still being recorded, see pollTail()
+    };
+
+    // Finest bucket size of the pyramid and the ratio between levels
+    static constexpr size_t kPeakBaseBucket = 64;
+    static constexpr size_t kPeakLevelFactor = 8;
+    // Samples per lazily decoded block, a multiple of kPeakBaseBucket
+    static constexpr size_t kBlockSamples = 1 << 16;
+    static constexpr size_t kMappedLoadThreshold = size_t(256) << 20;
+    static constexpr size_t kBlockCacheBytes = size_t(64) << 20;
+    // Address space mapped for a tailed file to grow into, days of audio
+    static constexpr size_t kTailReserveBytes = size_t(256) << 30;
+    static constexpr int kTailPollMs = 250;
+
+    AudioProcessor() = default;
+    ~AudioProcessor();
+    // Sample buffers are never copied implicitly, use getSamples() views
+    AudioProcessor(const AudioProcessor&) = delete;
+    AudioProcessor& operator=(const AudioProcessor&) = delete;
+
+    // Channels are stored planar, sample indices are per channel (frames)
+    bool loadWAV(const std::string& filename, LoadMode mode = LoadMode::Auto);
+    // Parses the header and returns, decoding continues on a loader thread.
+    // Samples and peaks become readable as getLoadedSamples() advances.
+    // Peaks are taken from cache instead when it was written for this file,
+    // a mapped load then has nothing left to do.
+    bool loadWAVAsync(const std::string& filename, LoadMode mode = LoadMode::Auto,
+                      const SidecarFile* cache = nullptr);
+    void stopLoading();
+    void waitUntilLoaded();
+    // Looks for frames appended to a file loaded with LoadMode::Tail, at
+    // most every kTailPollMs, and starts decoding them. Returns true when
+    // the file grew: getNumSamples() is larger and the samples past the
+    // old end become readable as getLoadedSamples() advances. UI thread only.
+    bool pollTail();
+    bool isTailing() const { return tailing; }
+    // Decoded blocks of mapped loads go to cache, shared with other files,
+    // instead of a cache of their own. Call before loading.
+    void shareBlockCache(std::shared_ptr<BlockCache> cache);
+    // Decoded samples and peaks held for this file, plus its own block cache
+    size_t getMemoryBytes() const;
+    // Watermark published by the loader, everything below it is final
+    size_t getLoadedSamples() const { return loadedSamples.load(std::memory_order_acquire); }
+    bool isLoaded() const { return getLoadedSamples() == numSamples; }
+    float getLoadProgress() const;
+    // Whole-channel view, empty when the file is mapped. Samples past
+    // getLoadedSamples() are not decoded yet. Prefer forEachBlock() or
+    // readSamples() which work in both modes and stop at the watermark.
+    SampleView getSamples(size_t channel = 0) const;
+    // Copies [startSample, startSample + count) of a channel into out, returns the number copied
+    size_t readSamples(size_t channel, size_t startSample, size_t count, float* out) const;
+    // Calls fn(SampleView, firstSample) for consecutive pieces of [startSample, endSample)
+    template <typename Fn>
+    void forEachBlock(size_t channel, size_t startSample, size_t endSample, Fn&& fn) const;
+    // Fills out with at most maxPoints values covering [startSample, endSample)
+    void getDownsampledData(size_t channel, size_t startSample, size_t endSample, size_t maxPoints, WaveformData& out) const;
+    // Buckets past getLoadedSamples() are not final yet
+    const std::vector<PeakLevel>& getPeakLevels(size_t channel = 0) const { return peakLevels[channel]; }
+    bool hasCachedPeaks() const { return peaksCached; }
     size_t getSampleRate() const { return sampleRate; }
-    size_t getNumSamples() const { return samples.size(); }
+    size_t getNumSamples() const { return numSamples.load(); }
+    size_t getNumChannels() const { return numChannels; }
+    bool isMapped() const { return mapped; }
+    SampleFormat getSampleFormat() const { return sampleFormat; }
+    // Interleaved source bytes of the frames from startSample on, nullptr
+    // once an in-memory load has released the file
+    const uint8_t* getRawFrames(size_t startSample) const;
+    size_t getFrameBytes() const { return sampleBytes * numChannels; }
 
 private:
-    std::vector<float> samples;
+    bool openWAV(const std::string& filename, LoadMode mode, const SidecarFile* cache = nullptr);
+    bool loadCachedPeaks(const std::string& filename, const SidecarFile& cache);
+    bool parseWAV();
+    size_t dataFrames() const;
+    void decodeAll();
+    BlockCache::Block decodedBlock(size_t blockIndex) const;
+    void allocatePeakLevels();
+    void appendBasePeaks(size_t channel, size_t firstSample, SampleView chunk);
+    void updatePeakLevels(size_t readySamples);
+
+    MappedFile file;
+    WAVHeader header{};
+    size_t dataOffset = 0;
+    // Where the data size is declared, 4 or 8 bytes wide. Wave64 sizes
+    // count the 24-byte chunk header.
+    size_t dataSizePos = 0;
+    size_t dataSizeBytes = 4;
+    size_t dataSizeBias = 0;
+    SampleFormat sampleFormat = SampleFormat::Int16;
+    size_t sampleBytes = 0;
+    bool mapped = false;
+
+    std::vector<std::vector<float>> channels;
+    // Only grows after the load, when a tailed file was appended to
+    std::atomic<size_t> numSamples{0};
+    size_t numChannels = 0;
+    // Mapped blocks hold every channel, planar, kBlockSamples frames each.
+    // Keys start at blockKeyBase, unique per load, so files sharing a cache
+    // never see each other's blocks.
+    std::shared_ptr<BlockCache> blockCache = std::make_shared<BlockCache>(kBlockCacheBytes);
+    bool sharedBlockCache = false;
+    uint64_t blockKeyBase = 0;
+    std::vector<std::vector<PeakLevel>> peakLevels;
+    // Finished buckets per level, only touched by the loader
+    std::vector<size_t> levelsReady;
+    bool peaksCached = false;
     size_t sampleRate = 0;
-};
\ No newline at end of file
+
+    std::thread loader;
+    std::atomic<size_t> loadedSamples{0};
+    std::atomic<bool> cancelLoad{false};
+    bool tailing = false;
+    std::chrono::steady_clock::time_point nextTailPoll;
+};
+
+template <typename Fn>
+void AudioProcessor::forEachBlock(size_t channel, size_t startSample, size_t endSample, Fn&& fn) const {
+    endSample = std::min(endSample, getLoadedSamples());
+    if (startSample >= endSample || channel >= numChannels) return;
+
+    if (!mapped) {
+        fn(getSamples(channel).subview(startSample, endSample - startSample), startSample);
+        return;
+    }
+
+    for (size_t b = startSample / kBlockSamples; b * kBlockSamples < endSample; ++b) {
+        BlockCache::Block block = decodedBlock(b);
+        size_t blockStart = b * kBlockSamples;
+        size_t blockFrames = block->size() / numChannels;
+        size_t from = std::max(startSample, blockStart);
+        size_t to = std::min(endSample, blockStart + blockFrames);
+        SampleView channelView(block->data() + channel * blockFrames, blockFrames);
+        fn(channelView.subview(from - blockStart, to - from), from);
+    }
+}
@@ -0,0 +1,326 @@
+// Headless clip extractor: cuts the marked parts of many WAV files into
+// labeled clips, one file per worker at a time, without SDL or OpenGL.
+#include "audio_processor.h"
+#include "markers.h"
+#include "resampler.h"
+#include "section_stats.h"
+#include "thread_pool.h"
+#include "wav_writer.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+static const char* kIntensityLabels[4] = {"low", "med", "high", "very_high"};
+
+struct BatchOptions {
+    std::string outDir = "clips";
+    size_t jobs = 0;
+    // Audio kept around point markers, in seconds
+    double pre = 0.5;
+    double post = 1.5;
+    // Also write level statistics of every section
+    bool stats = false;
+    // Clips are resampled to this rate, 0 keeps the source rate
+    size_t rate = 0;
+    std::vector<std::string> inputs;
+};
+
+struct BatchStats {
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> clips{0};
+    std::atomic<size_t> bytesIn{0};
+    std::atomic<size_t> bytesOut{0};
+};
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options] <wav file or directory>...\n", program);
+    printf("  -o, --out DIR    output directory (default: clips)\n");
+    printf("  -j, --jobs N     worker threads (default: one per hardware thread)\n");
+    printf("  --pre SECONDS    audio kept before a point marker (default: 0.5)\n");
+    printf("  --post SECONDS   audio kept after a point marker (default: 1.5)\n");
+    printf("  --stats          also write section_stats.csv with the levels of every section\n");
+    printf("  --rate HZ        resample every clip to HZ, written as float32\n");
+}
+
+static bool parseArgs(int argc, char* argv[], BatchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-o" || arg == "--out") && hasValue) {
+            options.outDir = argv[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+            options.jobs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--pre" && hasValue) {
+            options.pre = std::max(0.0, strtod(argv[++i], nullptr));
+        } else if (arg == "--post" && hasValue) {
+            options.post = std::max(0.0, strtod(argv[++i], nullptr));
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    return !options.inputs.empty();
+}
+
+static bool isWavPath(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".wav";
+}
+
+// Expands directories recursively, the result is sorted so runs are repeatable
+static std::vector<std::string> collectWavFiles(const std::vector<std::string>& inputs) {
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        std::error_code error;
+        if (fs::is_directory(input, error)) {
+            for (const auto& entry : fs::recursive_directory_iterator(input, error)) {
+                if (entry.is_regular_file(error) && isWavPath(entry.path())) {
+                    files.push_back(entry.path().string());
+                }
+            }
+        } else {
+            files.push_back(input);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+// Clip names start with the WAV stem, inputs sharing a stem get a suffix
+static std::vector<std::string> uniqueStems(const std::vector<std::string>& files) {
+    std::map<std::string, int> seen;
+    std::vector<std::string> stems;
+    for (const auto& file : files) {
+        std::string stem = fs::path(file).stem().string();
+        int n = seen[stem]++;
+        stems.push_back(n == 0 ? stem : stem + "_" + std::to_string(n));
+    }
+    return stems;
+}
+
+// Resamples output frames [first, first + frames) into interleaved floats at
+// the resampler's target rate. Blocks go to blockPool when there is one.
+static std::vector<float> resampleClip(const AudioProcessor& audio, const Resampler& resampler,
+                                       size_t first, size_t frames, ThreadPool* blockPool) {
+    size_t numChannels = audio.getNumChannels();
+    std::vector<float> planar(frames), window;
+    std::vector<float> interleaved(frames * numChannels);
+    for (size_t c = 0; c < numChannels; ++c) {
+        if (blockPool) {
+            resampler.processParallel(*blockPool, audio, c, first, frames, planar.data());
+        } else {
+            resampler.process(audio, c, first, frames, planar.data(), window);
+        }
+        for (size_t i = 0; i < frames; ++i) interleaved[i * numChannels + c] = planar[i];
+    }
+    return interleaved;
+}
+
+// Writes every clip of one WAV file, its manifest rows and its section
+// statistics rows
+static void processFile(const std::string& wavFile, const std::string& stem, const BatchOptions& options,
+                        std::string& manifest, std::string& sectionRows, BatchStats& stats,
+                        ThreadPool* blockPool) {
+    std::vector<Marker> marks;
+    if (!loadMarkersCsv(markerCsvPath(wavFile), marks)) {
+        printf("%s: no markers CSV, skipped\n", wavFile.c_str());
+        stats.failed++;
+        return;
+    }
+
+    // Clips are copied straight from the mapped PCM, only resampled ones
+    // are decoded
+    AudioProcessor audio;
+    if (!audio.loadWAV(wavFile, AudioProcessor::LoadMode::Raw)) {
+        printf("%s: cannot read WAV, skipped\n", wavFile.c_str());
+        stats.failed++;
+        return;
+    }
+
+    size_t sampleRate = audio.getSampleRate();
+    Resampler resampler(sampleRate, options.rate != 0 ? options.rate : sampleRate);
+    bool resampling = !resampler.isIdentity();
+    size_t clipRate = resampler.getTargetRate();
+    SampleFormat clipFormat = resampling ? SampleFormat::Float32 : audio.getSampleFormat();
+    size_t clipFrameBytes = resampling ? sizeof(float) * audio.getNumChannels() : audio.getFrameBytes();
+    // Clip bounds are frames of the file at the clip rate, so clips of one
+    // marker line up across rates
+    size_t numFrames = resampler.toTarget(audio.getNumSamples());
+    size_t preFrames = static_cast<size_t>(options.pre * clipRate);
+    size_t postFrames = static_cast<size_t>(options.post * clipRate);
+    std::vector<Marker> clipMarks;
+    clipMarks.reserve(marks.size());
+    for (const Marker& mark : marks) clipMarks.push_back(resampler.toTarget(mark));
+    if (options.rate != 0) {
+        // The markers at the new rate, for tools reading the clips together
+        fs::path csvPath = fs::path(options.outDir) / "markers" / (stem + ".csv");
+        if (!saveMarkersCsv(csvPath.string(), clipMarks)) {
+            printf("%s: cannot write %s\n", wavFile.c_str(), csvPath.string().c_str());
+        }
+    }
+
+    char line[1024];
+    for (size_t m = 0; m < marks.size(); ++m) {
+        const Marker& mark = marks[m];
+        const Marker& clipMark = clipMarks[m];
+        size_t start, end;
+        const char* label;
+        if (mark.end != 0) {
+            // Sections include their end sample
+            start = clipMark.sample;
+            end = clipMark.end + 1;
+            label = "sections";
+        } else if (mark.intensity >= 0 && mark.intensity < 4) {
+            start = clipMark.sample > preFrames ? clipMark.sample - preFrames : 0;
+            end = clipMark.sample + postFrames;
+            label = kIntensityLabels[mark.intensity];
+        } else {
+            continue;
+        }
+        end = std::min(end, numFrames);
+        if (start >= end) continue;
+
+        char name[64];
+        if (mark.end != 0) {
+            snprintf(name, sizeof(name), "_%zu_%zu.wav", mark.sample, mark.end);
+        } else {
+            snprintf(name, sizeof(name), "_%zu.wav", mark.sample);
+        }
+        fs::path clipPath = fs::path(options.outDir) / label / (stem + name);
+        size_t frames = end - start;
+        bool written;
+        if (resampling) {
+            std::vector<float> clip = resampleClip(audio, resampler, start, frames, blockPool);
+            written = writeWAV(clipPath.string(), clipFormat, audio.getNumChannels(), clipRate,
+                               reinterpret_cast<const uint8_t*>(clip.data()), frames);
+        } else {
+            written = writeWAV(clipPath.string(), clipFormat, audio.getNumChannels(), clipRate,
+                               audio.getRawFrames(start), frames);
+        }
+        if (!written) {
+            printf("%s: cannot write %s\n", wavFile.c_str(), clipPath.string().c_str());
+            continue;
+        }
+
+        snprintf(line, sizeof(line), "%s,%s,%s,%zu,%zu,%zu,%zu,%s\n",
+            clipPath.string().c_str(), wavFile.c_str(), label, start, end,
+            clipRate, audio.getNumChannels(), sampleFormatName(clipFormat));
+        manifest += line;
+        stats.clips++;
+        stats.bytesOut += frames * clipFrameBytes + 44;
+    }
+
+    // Runs on this worker, files are already spread over the pool. A worker
+    // can't wait on its own pool, the sections get a thread of their own.
+    if (options.stats) {
+        ThreadPool statsPool(1);
+        SectionStats sectionStats(statsPool);
+        sectionStats.build(audio);
+        for (const auto& section : sectionStats.computeSections(marks)) {
+            SectionStats::appendCsvRow(sectionRows, wavFile, section);
+        }
+    }
+
+    std::error_code error;
+    stats.bytesIn += fs::file_size(wavFile, error);
+    stats.files++;
+}
+
+int main(int argc, char* argv[]) {
+    BatchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> files = collectWavFiles(options.inputs);
+    if (files.empty()) {
+        printf("No WAV files found\n");
+        return 1;
+    }
+    std::vector<std::string> stems = uniqueStems(files);
+
+    std::error_code error;
+    fs::create_directories(fs::path(options.outDir) / "sections", error);
+    if (options.rate != 0) fs::create_directories(fs::path(options.outDir) / "markers", error);
+    for (const char* label : kIntensityLabels) {
+        fs::create_directories(fs::path(options.outDir) / label, error);
+    }
+    if (error) {
+        printf("Cannot create %s: %s\n", options.outDir.c_str(), error.message().c_str());
+        return 1;
+    }
+
+    // Files are the unit of work, each task owns its manifest slot so the
+    // workers never share anything but the counters
+    BatchStats stats;
+    std::vector<std::string> manifests(files.size());
+    std::vector<std::string> sectionRows(files.size());
+    auto started = std::chrono::steady_clock::now();
+    size_t numThreads;
+    {
+        ThreadPool pool(options.jobs);
+        numThreads = pool.size();
+        if (files.size() == 1) {
+            // A single file has its resampling blocks spread over the pool instead
+            processFile(files[0], stems[0], options, manifests[0], sectionRows[0], stats, &pool);
+        } else {
+            for (size_t i = 0; i < files.size(); ++i) {
+                pool.submit([&, i] { processFile(files[i], stems[i], options, manifests[i], sectionRows[i], stats, nullptr); });
+            }
+            pool.wait();
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    std::string manifest = "clip,source,label,start,end,sampleRate,channels,format\n";
+    for (const auto& rows : manifests) {
+        manifest += rows;
+    }
+    std::string manifestPath = (fs::path(options.outDir) / "manifest.csv").string();
+    if (!writeFileAtomic(manifestPath, manifest)) {
+        printf("Cannot write %s\n", manifestPath.c_str());
+        return 1;
+    }
+
+    std::string statsPath = (fs::path(options.outDir) / "section_stats.csv").string();
+    if (options.stats) {
+        std::string statsCsv = SectionStats::csvHeader();
+        for (const auto& rows : sectionRows) {
+            statsCsv += rows;
+        }
+        if (!writeFileAtomic(statsPath, statsCsv)) {
+            printf("Cannot write %s\n", statsPath.c_str());
+            return 1;
+        }
+    }
+
+    double seconds = std::max(elapsed.count(), 1e-9);
+    printf("Processed %zu files (%zu skipped), %zu clips in %.2f s with %zu threads\n",
+        stats.files.load(), stats.failed.load(), stats.clips.load(), seconds, numThreads);
+    printf("%.1f files/s, %.1f MB/s of source audio, %.1f MB/s of clips\n",
+        stats.files / seconds, stats.bytesIn / seconds / 1e6, stats.bytesOut / seconds / 1e6);
+    printf("Manifest: %s\n", manifestPath.c_str());
+    if (options.stats) {
+        printf("Section stats: %s\n", statsPath.c_str());
+    }
+    return 0;
+}
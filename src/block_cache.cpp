@@ -0,0 +1,54 @@
+#include "block_cache.h"
+
+static size_t blockBytes(const BlockCache::Block& block) {
+    return block->size() * sizeof(float);
+}
+
+BlockCache::Block BlockCache::get(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) return nullptr;
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+    return it->second.block;
+}
+
+void BlockCache::put(uint64_t key, Block block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second.lruPos);
+        // Another reader decoded the same block first, keep theirs unless
+        // it is the shorter last block of a file that has grown since
+        if (it->second.block->size() >= block->size()) return;
+        used += blockBytes(block) - blockBytes(it->second.block);
+        it->second.block = std::move(block);
+        evict();
+        return;
+    }
+    used += blockBytes(block);
+    lru.push_front(key);
+    entries.emplace(key, Entry{std::move(block), lru.begin()});
+    evict();
+}
+
+void BlockCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    used = 0;
+}
+
+size_t BlockCache::getUsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+void BlockCache::evict() {
+    // Always keep the block that was just inserted
+    while (used > budget && lru.size() > 1) {
+        auto it = entries.find(lru.back());
+        used -= blockBytes(it->second.block);
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+// Thread-safe LRU cache of decoded sample blocks, bounded by memory use.
+// Blocks are shared_ptrs so an evicted block stays valid for its readers.
+class BlockCache {
+public:
+    using Block = std::shared_ptr<const std::vector<float>>;
+
+    explicit BlockCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    // Returns the cached block or nullptr, marking it most recently used
+    Block get(uint64_t key);
+    void put(uint64_t key, Block block);
+    void clear();
+
+    size_t getBudget() const { return budget; }
+    size_t getUsedBytes() const;
+
+private:
+    struct Entry {
+        Block block;
+        std::list<uint64_t>::iterator lruPos;
+    };
+
+    void evict();
+
+    mutable std::mutex mutex;
+    std::list<uint64_t> lru; // front is most recently used
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t budget;
+    size_t used = 0;
+};
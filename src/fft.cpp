@@ -0,0 +1,132 @@
+#include "fft.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FFT_X86
+#endif
+
+FFT::FFT(size_t size) : n(size), half(size / 2) {
+    int bits = 0;
+    while ((size_t(1) << bits) < half) bits++;
+    bitReverse.resize(half);
+    for (size_t i = 0; i < half; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b) {
+            if (i & (size_t(1) << b)) r |= 1u << (bits - 1 - b);
+        }
+        bitReverse[i] = r;
+    }
+
+    twiddleRe.resize(half);
+    twiddleIm.resize(half);
+    for (size_t h = 1; h < half; h *= 2) {
+        for (size_t k = 0; k < h; ++k) {
+            double angle = -M_PI * k / h;
+            twiddleRe[h - 1 + k] = static_cast<float>(std::cos(angle));
+            twiddleIm[h - 1 + k] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    splitRe.resize(half);
+    splitIm.resize(half);
+    for (size_t k = 0; k < half; ++k) {
+        double angle = -2.0 * M_PI * k / n;
+        splitRe[k] = static_cast<float>(std::cos(angle));
+        splitIm[k] = static_cast<float>(std::sin(angle));
+    }
+
+    window.resize(n);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / n));
+        sum += window[i];
+    }
+    // A full scale sine peaks at sum(window) / 2 in its bin
+    windowGain = static_cast<float>(sum / 2.0);
+
+    re.resize(half);
+    im.resize(half);
+    windowed.resize(n);
+}
+
+#ifdef FFT_X86
+// Four butterflies at a time, h is a multiple of 4
+__attribute__((target("sse2")))
+static void butterfliesSSE2(float* re, float* im, const float* wr, const float* wi, size_t h) {
+    for (size_t k = 0; k < h; k += 4) {
+        __m128 ar = _mm_loadu_ps(re + k), ai = _mm_loadu_ps(im + k);
+        __m128 br = _mm_loadu_ps(re + h + k), bi = _mm_loadu_ps(im + h + k);
+        __m128 cr = _mm_loadu_ps(wr + k), ci = _mm_loadu_ps(wi + k);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(br, cr), _mm_mul_ps(bi, ci));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(br, ci), _mm_mul_ps(bi, cr));
+        _mm_storeu_ps(re + k, _mm_add_ps(ar, tr));
+        _mm_storeu_ps(im + k, _mm_add_ps(ai, ti));
+        _mm_storeu_ps(re + h + k, _mm_sub_ps(ar, tr));
+        _mm_storeu_ps(im + h + k, _mm_sub_ps(ai, ti));
+    }
+}
+#endif
+
+static void butterfliesScalar(float* re, float* im, const float* wr, const float* wi, size_t h) {
+    for (size_t k = 0; k < h; ++k) {
+        float tr = re[h + k] * wr[k] - im[h + k] * wi[k];
+        float ti = re[h + k] * wi[k] + im[h + k] * wr[k];
+        re[h + k] = re[k] - tr;
+        im[h + k] = im[k] - ti;
+        re[k] += tr;
+        im[k] += ti;
+    }
+}
+
+void FFT::transform() {
+    // In-place decimation in time on the bit-reversed input
+    for (size_t h = 1; h < half; h *= 2) {
+        const float* wr = twiddleRe.data() + h - 1;
+        const float* wi = twiddleIm.data() + h - 1;
+        for (size_t start = 0; start < half; start += 2 * h) {
+#ifdef FFT_X86
+            if (h >= 4) {
+                butterfliesSSE2(re.data() + start, im.data() + start, wr, wi, h);
+                continue;
+            }
+#endif
+            butterfliesScalar(re.data() + start, im.data() + start, wr, wi, h);
+        }
+    }
+}
+
+void FFT::powerSpectrum(const float* in, float* out) {
+    // Even samples go to the real part, odd ones to the imaginary part
+    for (size_t i = 0; i < half; ++i) {
+        re[bitReverse[i]] = in[2 * i];
+        im[bitReverse[i]] = in[2 * i + 1];
+    }
+    transform();
+
+    // X[k] = E[k] + w^k O[k], with E and O recovered from Z[k] and Z[half - k]
+    out[0] = (re[0] + im[0]) * (re[0] + im[0]);
+    for (size_t k = 1; k < half; ++k) {
+        float zr = re[k], zi = im[k];
+        float cr = re[half - k], ci = -im[half - k];
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        // O[k] = (Z[k] - conj(Z[half - k])) / 2i
+        float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+        float xr = er + splitRe[k] * orr - splitIm[k] * oi;
+        float xi = ei + splitRe[k] * oi + splitIm[k] * orr;
+        out[k] = xr * xr + xi * xi;
+    }
+}
+
+void FFT::spectrumDb(const float* in, float* out, float floorDb) {
+    for (size_t i = 0; i < n; ++i) {
+        windowed[i] = in[i] * window[i];
+    }
+    powerSpectrum(windowed.data(), out);
+    float reference = windowGain * windowGain;
+    float floorPower = std::pow(10.0f, floorDb / 10.0f);
+    for (size_t k = 0; k < half; ++k) {
+        out[k] = 10.0f * std::log10(std::max(out[k] / reference, floorPower));
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Radix-2 FFT of real input, sized once up front. The complex transform
+// runs on split real/imaginary arrays so the butterflies vectorize, the
+// real input is packed into a half-size complex transform.
+//
+// An instance keeps scratch buffers, use one per thread.
+class FFT {
+public:
+    // size is a power of two, at least 8
+    explicit FFT(size_t size);
+
+    size_t size() const { return n; }
+    size_t numBins() const { return n / 2; }
+
+    // Hann-windowed spectrum of size() samples in dB relative to a full
+    // scale sine, numBins() values from DC up to just below Nyquist
+    void spectrumDb(const float* in, float* out, float floorDb = -120.0f);
+    // Unwindowed power |X[k]|^2 for k in [0, numBins())
+    void powerSpectrum(const float* in, float* out);
+
+private:
+    void transform();
+
+    size_t n;
+    size_t half;
+    std::vector<uint32_t> bitReverse;
+    // Twiddles of every stage back to back, stage of span 2h starts at h - 1
+    std::vector<float> twiddleRe, twiddleIm;
+    // e^(-2 pi i k / n), used to split the packed half-size transform
+    std::vector<float> splitRe, splitIm;
+    std::vector<float> window;
+    float windowGain;
+
+    std::vector<float> re, im;
+    std::vector<float> windowed;
+};
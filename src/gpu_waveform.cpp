@@ -0,0 +1,281 @@
+#include "gpu_waveform.h"
+#include "profiler.h"
+#include "implot.h"
+#include <algorithm>
+#include <cstdio>
+
+// One quad over the whole viewport, the scissor box keeps it in the plot
+static const char* kVertexShader = R"(#version 150
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Fills the pixels of each column between the lowest min and highest max of
+// its buckets. The bucket before the column is included, like the CPU line
+// joins consecutive buckets, so steep edges don't break into dots.
+static const char* kFragmentShader = R"(#version 150
+uniform samplerBuffer uPeaks;
+uniform int uLevelOffset;
+uniform int uLevelBuckets;
+uniform float uFirstBucket;
+uniform float uBucketsPerPixel;
+uniform float uPlotX0;
+uniform float uPlotY0;
+uniform float uPlotHeight;
+uniform float uYMin;
+uniform float uYMax;
+uniform vec4 uColor;
+out vec4 outColor;
+
+void main() {
+    float start = uFirstBucket + (floor(gl_FragCoord.x) - uPlotX0) * uBucketsPerPixel;
+    int first = max(int(floor(start)) - 1, 0);
+    int last = min(max(int(ceil(start + uBucketsPerPixel)), first + 1), uLevelBuckets);
+    if (first >= last) discard;
+
+    vec2 range = texelFetch(uPeaks, uLevelOffset + first).rg;
+    for (int b = first + 1; b < last && b < first + 64; ++b) {
+        vec2 peak = texelFetch(uPeaks, uLevelOffset + b).rg;
+        range = vec2(min(range.x, peak.x), max(range.y, peak.y));
+    }
+
+    // Half a pixel of slack so silence still draws a line
+    float unitsPerPixel = (uYMax - uYMin) / uPlotHeight;
+    float value = uYMin + (gl_FragCoord.y - uPlotY0) * unitsPerPixel;
+    if (value < range.x - 0.5 * unitsPerPixel || value > range.y + 0.5 * unitsPerPixel) discard;
+    outColor = uColor;
+}
+)";
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        printf("Waveform shader failed to compile: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Next power of two, so a followed file doesn't reallocate on every poll
+static size_t roundUpPow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+void GpuWaveform::releaseBuffers() {
+    for (auto& channel : channels) {
+        if (channel.texture != 0) glDeleteTextures(1, &channel.texture);
+        if (channel.buffer != 0) glDeleteBuffers(1, &channel.buffer);
+    }
+    channels.clear();
+}
+
+void GpuWaveform::clear() {
+    releaseBuffers();
+    if (program != 0) glDeleteProgram(program);
+    if (vertexArray != 0) glDeleteVertexArrays(1, &vertexArray);
+    program = 0;
+    vertexArray = 0;
+    drawCalls.clear();
+    unsupported = false;
+}
+
+bool GpuWaveform::ensureProgram() {
+    if (program != 0) return true;
+    if (unsupported) return false;
+
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, kVertexShader);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+    if (vertex != 0 && fragment != 0) {
+        program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glBindFragDataLocation(program, 0, "outColor");
+        glLinkProgram(program);
+        GLint status = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (vertex != 0) glDeleteShader(vertex);
+    if (fragment != 0) glDeleteShader(fragment);
+    if (program == 0) {
+        printf("Waveform shader unavailable, drawing on the CPU\n");
+        releaseBuffers();
+        unsupported = true;
+        return false;
+    }
+    // Core profile wants a bound VAO even without attributes
+    glGenVertexArrays(1, &vertexArray);
+    return true;
+}
+
+bool GpuWaveform::allocate(const AudioProcessor& audio) {
+    releaseBuffers();
+    size_t numChannels = audio.getNumChannels();
+    const std::vector<AudioProcessor::PeakLevel>& levels = audio.getPeakLevels(0);
+    if (numChannels == 0 || levels.size() <= kFirstLevel) return false;
+
+    // A followed file keeps growing, its levels get room to grow into
+    std::vector<size_t> capacity, offsets;
+    size_t texels = 0;
+    for (size_t l = kFirstLevel; l < levels.size(); ++l) {
+        size_t buckets = levels[l].peaks.size() / 2;
+        capacity.push_back(audio.isTailing() ? roundUpPow2(buckets) : buckets);
+        offsets.push_back(texels);
+        texels += capacity.back();
+    }
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (texels == 0 || texels > static_cast<size_t>(maxTexels)) {
+        printf("Waveform peaks exceed the texture buffer limit, drawing on the CPU\n");
+        unsupported = true;
+        return false;
+    }
+
+    channels.resize(numChannels);
+    for (auto& channel : channels) {
+        glGenBuffers(1, &channel.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, channel.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, texels * 2 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+        glGenTextures(1, &channel.texture);
+        glBindTexture(GL_TEXTURE_BUFFER, channel.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, channel.buffer);
+        channel.levelCapacity = capacity;
+        channel.levelOffsets = offsets;
+        channel.uploaded.assign(capacity.size(), 0);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return true;
+}
+
+void GpuWaveform::update(const AudioProcessor& audio) {
+    // Last frame's draws have been rendered
+    drawCalls.clear();
+    if (unsupported) return;
+
+    // New levels or a file that outgrew its room start over
+    const std::vector<AudioProcessor::PeakLevel>& levels = audio.getPeakLevels(0);
+    bool fits = !channels.empty() && channels.size() == audio.getNumChannels() &&
+        channels[0].levelCapacity.size() + kFirstLevel == levels.size();
+    for (size_t l = kFirstLevel; fits && l < levels.size(); ++l) {
+        fits = levels[l].peaks.size() / 2 <= channels[0].levelCapacity[l - kFirstLevel];
+    }
+    if (!fits && !allocate(audio)) return;
+
+    PROFILE_SCOPE("waveform upload");
+    // Same finished buckets getDownsampledData() reads
+    size_t loaded = audio.getLoadedSamples();
+    bool complete = loaded == audio.getNumSamples();
+    for (size_t c = 0; c < channels.size(); ++c) {
+        Channel& channel = channels[c];
+        const std::vector<AudioProcessor::PeakLevel>& peaks = audio.getPeakLevels(c);
+        glBindBuffer(GL_TEXTURE_BUFFER, channel.buffer);
+        for (size_t i = 0; i < channel.uploaded.size(); ++i) {
+            const AudioProcessor::PeakLevel& level = peaks[i + kFirstLevel];
+            size_t buckets = level.peaks.size() / 2;
+            size_t ready = complete ? buckets : std::min(loaded / level.samplesPerBucket, buckets);
+            // The watermark went back when a followed file grew, the buckets
+            // past it are rebuilt and sent again
+            size_t& uploaded = channel.uploaded[i];
+            uploaded = std::min(uploaded, ready);
+            if (ready == uploaded) continue;
+            glBufferSubData(GL_TEXTURE_BUFFER, (channel.levelOffsets[i] + uploaded) * 2 * sizeof(float),
+                (ready - uploaded) * 2 * sizeof(float), level.peaks.data() + uploaded * 2);
+            uploaded = ready;
+        }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+bool GpuWaveform::draw(const AudioProcessor& audio, size_t channel, const ImVec4& color) {
+    if (unsupported || channel >= channels.size()) return false;
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    ImVec2 pos = ImPlot::GetPlotPos();
+    ImVec2 size = ImPlot::GetPlotSize();
+    if (size.x < 1.0f || size.y < 1.0f || limits.X.Max <= limits.X.Min) return false;
+
+    // Finest level with few enough buckets per pixel. Closer in than one
+    // bucket per pixel the CPU draws the actual samples instead.
+    const std::vector<AudioProcessor::PeakLevel>& levels = audio.getPeakLevels(channel);
+    double samplesPerPixel = (limits.X.Max - limits.X.Min) / size.x;
+    if (samplesPerPixel < levels[kFirstLevel].samplesPerBucket) return false;
+    size_t level = kFirstLevel;
+    while (level < levels.size() && samplesPerPixel / levels[level].samplesPerBucket > kMaxBucketsPerPixel) level++;
+    if (level == levels.size() || !ensureProgram()) return false;
+
+    const Channel& mirror = channels[channel];
+    size_t spb = levels[level].samplesPerBucket;
+    DrawCall call;
+    call.owner = this;
+    call.texture = mirror.texture;
+    call.levelOffset = static_cast<int>(mirror.levelOffsets[level - kFirstLevel]);
+    call.levelBuckets = static_cast<int>(mirror.uploaded[level - kFirstLevel]);
+    call.firstBucket = static_cast<float>(limits.X.Min / spb);
+    call.bucketsPerPixel = static_cast<float>(samplesPerPixel / spb);
+    call.plotMin = pos;
+    call.plotMax = ImVec2(pos.x + size.x, pos.y + size.y);
+    call.yMin = static_cast<float>(limits.Y.Min);
+    call.yMax = static_cast<float>(limits.Y.Max);
+    call.color = color;
+    drawCalls.push_back(call);
+
+    ImDrawList* drawList = ImPlot::GetPlotDrawList();
+    drawList->AddCallback(render, &drawCalls.back());
+    drawList->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+    // Keeps the legend entry the line would have had
+    ImPlot::SetNextLineStyle(color);
+    ImPlot::PlotDummy("Waveform");
+    return true;
+}
+
+void GpuWaveform::render(const ImDrawList*, const ImDrawCmd* cmd) {
+    const DrawCall& call = *static_cast<const DrawCall*>(cmd->UserCallbackData);
+    const GpuWaveform& self = *call.owner;
+    ImDrawData* drawData = ImGui::GetDrawData();
+    ImVec2 offset = drawData->DisplayPos;
+    ImVec2 scale = drawData->FramebufferScale;
+    float framebufferHeight = drawData->DisplaySize.y * scale.y;
+
+    // The plot area inside whatever clips the plot window
+    float x0 = std::max(cmd->ClipRect.x, call.plotMin.x) - offset.x;
+    float y0 = std::max(cmd->ClipRect.y, call.plotMin.y) - offset.y;
+    float x1 = std::min(cmd->ClipRect.z, call.plotMax.x) - offset.x;
+    float y1 = std::min(cmd->ClipRect.w, call.plotMax.y) - offset.y;
+    if (x1 <= x0 || y1 <= y0) return;
+    glScissor((int)(x0 * scale.x), (int)(framebufferHeight - y1 * scale.y),
+        (int)((x1 - x0) * scale.x), (int)((y1 - y0) * scale.y));
+
+    // Uniforms are in framebuffer pixels, Y up like gl_FragCoord
+    GLuint program = self.program;
+    glUseProgram(program);
+    glBindVertexArray(self.vertexArray);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, call.texture);
+    glUniform1i(glGetUniformLocation(program, "uPeaks"), 0);
+    glUniform1i(glGetUniformLocation(program, "uLevelOffset"), call.levelOffset);
+    glUniform1i(glGetUniformLocation(program, "uLevelBuckets"), call.levelBuckets);
+    glUniform1f(glGetUniformLocation(program, "uFirstBucket"), call.firstBucket);
+    glUniform1f(glGetUniformLocation(program, "uBucketsPerPixel"), call.bucketsPerPixel / scale.x);
+    glUniform1f(glGetUniformLocation(program, "uPlotX0"), (call.plotMin.x - offset.x) * scale.x);
+    glUniform1f(glGetUniformLocation(program, "uPlotY0"), framebufferHeight - (call.plotMax.y - offset.y) * scale.y);
+    glUniform1f(glGetUniformLocation(program, "uPlotHeight"), (call.plotMax.y - call.plotMin.y) * scale.y);
+    glUniform1f(glGetUniformLocation(program, "uYMin"), call.yMin);
+    glUniform1f(glGetUniformLocation(program, "uYMax"), call.yMax);
+    glUniform4f(glGetUniformLocation(program, "uColor"), call.color.x, call.color.y, call.color.z, call.color.w);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
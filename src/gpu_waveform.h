@@ -0,0 +1,77 @@
+#pragma once
+#include "audio_processor.h"
+#include "imgui.h"
+#include <GL/gl3w.h>
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+// Peak pyramid kept on the GPU, drawn by a fragment shader.
+//
+// Levels from kFirstLevel up are mirrored per channel into one buffer
+// texture of (min, max) texels, uploaded as the loader publishes them. A
+// frame then costs one quad per channel: for every pixel column the shader
+// reads the few buckets under it and fills the pixels between their min and
+// max. Views zoomed in further than kFirstLevel's buckets are left to the
+// CPU path, which draws few points there anyway.
+class GpuWaveform {
+public:
+    // The base level would take 8 times the memory of the rest together
+    static constexpr size_t kFirstLevel = 1;
+    // Buckets read per pixel column at most, a level is picked to stay below
+    static constexpr double kMaxBucketsPerPixel = 16.0;
+
+    GpuWaveform() = default;
+    // Buffers must be gone through clear() by then
+    ~GpuWaveform() = default;
+    GpuWaveform(const GpuWaveform&) = delete;
+    GpuWaveform& operator=(const GpuWaveform&) = delete;
+
+    // Drops buffers and the shader, call with the GL context current
+    void clear();
+    // Uploads the buckets published since the last call, once per frame
+    // before drawing. UI thread only.
+    void update(const AudioProcessor& audio);
+    // Queues the channel's waveform into the current ImPlot plot. False when
+    // the view is too zoomed in or the GL context can't run the shader, the
+    // caller then draws it on the CPU.
+    bool draw(const AudioProcessor& audio, size_t channel, const ImVec4& color);
+
+private:
+    struct Channel {
+        GLuint buffer = 0;
+        GLuint texture = 0;
+        // Room for every mirrored level, where each starts in the buffer and
+        // how many of its buckets are uploaded
+        std::vector<size_t> levelCapacity;
+        std::vector<size_t> levelOffsets;
+        std::vector<size_t> uploaded;
+    };
+
+    // What the draw callback needs, kept until the frame is rendered
+    struct DrawCall {
+        GpuWaveform* owner;
+        GLuint texture;
+        int levelOffset;
+        int levelBuckets;
+        float firstBucket;
+        float bucketsPerPixel;
+        ImVec2 plotMin;
+        ImVec2 plotMax;
+        float yMin;
+        float yMax;
+        ImVec4 color;
+    };
+
+    bool ensureProgram();
+    bool allocate(const AudioProcessor& audio);
+    void releaseBuffers();
+    static void render(const ImDrawList* list, const ImDrawCmd* cmd);
+
+    std::vector<Channel> channels;
+    // Callbacks point into it, so it only grows during a frame
+    std::deque<DrawCall> drawCalls;
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    bool unsupported = false;
+};
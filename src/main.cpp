@@ -4,32 +4,55 @@
 #include "imgui_impl_opengl3.h"
 #include "implot.h"
 #include "audio_processor.h"
+#include "audio_player.h"
+#include "spectrogram.h"
+#include "waveform_layer.h"
+#include "waveform_plot.h"
+#include "gpu_waveform.h"
+#include "markers.h"
+#include "marker_batch.h"
+#include "marker_journal.h"
+#include "marker_history.h"
+#include "marker_store.h"
+#include "onset_detector.h"
+#include "section_stats.h"
+#include "sidecar.h"
+#include "session.h"
+#include "perf_hud.h"
+#include "profiler.h"
 #include <SDL.h>
 #include <GL/gl3w.h>
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <fstream>
-#include <sstream>
 #include <string>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <memory>
+#include <filesystem>
+
+namespace fs = std::filesystem;
 
 template<typename T> static inline T ImMin(T lhs, T rhs)                        { return lhs < rhs ? lhs : rhs; }
 template<typename T> static inline T ImMax(T lhs, T rhs)                        { return lhs >= rhs ? lhs : rhs; }
 
 class AudioVisualizer {
 public:
-    AudioVisualizer() : windowWidth(1280), windowHeight(720) {
-        initAudioPlayback();
+    explicit AudioVisualizer(size_t cacheBytes = Session::kDefaultBudgetBytes)
+        : windowWidth(1280), windowHeight(720), session(cacheBytes) {
     }
 
-    struct Marker {
-        size_t sample;
-        int intensity; // -1: section, 0: Low, 1: Med, 2: High, 3: Very High
-        size_t end;
-    };
-    
-    bool init(const char* wavFile) {
-        currentWavFile = wavFile;
+    // path is a WAV file, a directory or a playlist
+    bool init(const char* path, bool tail = false) {
+        if (!session.open(path)) {
+            printf("No audio files in %s\n", path);
+            return false;
+        }
+        if (tail) session.setLoadMode(AudioProcessor::LoadMode::Tail);
         // Setup SDL window
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -39,8 +62,7 @@ public:
         SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
         SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 
-        std::string window_name = std::string("Audio Visualizer - ") + wavFile;
-        window = SDL_CreateWindow(window_name.data(),
+        window = SDL_CreateWindow("Audio Visualizer",
             SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
             windowWidth, windowHeight,
             SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
@@ -61,104 +83,147 @@ public:
         ImGui_ImplSDL2_InitForOpenGL(window, glContext);
         ImGui_ImplOpenGL3_Init("#version 130");
 
-        // Load WAV file
-        if (!audioProcessor.loadWAV(wavFile)) {
-            return false;
-        }
+        profilerSetThreadName("ui");
+        return openFile(0);
+    }
+
+    void cleanup() {
+        closeFile();
+
+        // Existing cleanup code...
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplSDL2_Shutdown();
+        ImPlot::DestroyContext();
+        ImGui::DestroyContext();
+        SDL_GL_DeleteContext(glContext);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+
+    // Makes a file of the session the one on screen, its audio comes from
+    // the session cache when it was open before or prefetched
+    bool openFile(size_t index) {
+        std::shared_ptr<AudioProcessor> audio = session.select(index);
+        if (!audio) return false;
+        audioProcessor = std::move(audio);
+        std::string wavFile = session.getFile(index);
+        currentWavFile = wavFile;
+        std::string window_name = std::string("Audio Visualizer - ") + wavFile;
+        SDL_SetWindowTitle(window, window_name.c_str());
+
+        // Markers and analysis of an earlier session, each part is only used
+        // if the file it came from is unchanged. The session took the peaks.
+        SidecarFile sidecar;
+        const SidecarFile* cache = sidecar.open(sidecarPath(wavFile)) ? &sidecar : nullptr;
 
-        // Construct CSV filename (same base name as WAV file)
-        std::string csvFilename = std::string(wavFile);
-        size_t dotPos = csvFilename.find_last_of('.');
-        if (dotPos != std::string::npos) {
-            csvFilename = csvFilename.substr(0, dotPos) + ".csv";
+        // Decoding continues in the background while we draw
+        spectrogram = std::make_unique<Spectrogram>(*audioProcessor, analysisPool);
+        waveforms = std::vector<WaveformLayer>(audioProcessor->getNumChannels());
+
+        // The header is parsed, so the device can run at the file's rate
+        if (!player.open(*audioProcessor)) {
+            printf("Playback disabled\n");
         }
 
-        // Load markers from CSV
-        std::ifstream csvFile(csvFilename);
-        if (csvFile.is_open()) {
-            std::string line;
-            while (std::getline(csvFile, line)) {
-                std::istringstream ss(line);
-                std::string sampleStr, intensityStr, endStr;
-                
-                // Parse sample number and intensity
-                if (std::getline(ss, sampleStr, ',') && 
-                    std::getline(ss, intensityStr, ',')) {
-                    try {
-                        size_t sample = std::stoull(sampleStr);
-                        int intensity = std::stoi(intensityStr);
-                        if (intensity == -1 && std::getline(ss, endStr)) {
-                            size_t end = std::stoull(endStr);
-                            marks.push_back({sample, intensity, end});
-                        } else {
-                            marks.push_back({sample, intensity});
-                        }
-                    } catch (const std::exception& e) {
-                        printf("Error parsing CSV line: %s\n", line.c_str());
-                    }
-                }
-            }
-            
-            // Sort markers after loading
-            std::sort(marks.begin(), marks.end(), 
-                [](const Marker& a, const Marker& b) { 
-                    return a.sample < b.sample; 
-                });
-            
-            printf("Loaded %zu markers from CSV\n", marks.size());
+        // Load markers from CSV plus any edits a crashed session left in its journal
+        std::string csvFilename = markerCsvPath(wavFile);
+        if (journal.open(csvFilename, markers, cache)) {
+            printf("Loaded %zu markers from CSV\n", markers.size());
         } else {
             printf("No markers CSV found at %s\n", csvFilename.c_str());
         }
 
+        FileStamp csvStamp;
+        bool markersCovered = sidecar.matchesCsv(csvFilename) ||
+            (!sidecar.hasMarkers() && !stampFile(csvFilename, csvStamp));
+        sidecarCurrent = audioProcessor->hasCachedPeaks() && markersCovered;
+        if (cache && sidecar.matchesWav(wavFile)) {
+            OnsetDetector::Envelopes envelopes;
+            uint64_t hop = 0, fluxHop = 0;
+            size_t rmsCount = 0, fluxCount = 0;
+            const float* rms = sidecar.findArray(SidecarFile::kTagRms, 0, 0, hop, rmsCount);
+            const float* flux = sidecar.findArray(SidecarFile::kTagFlux, 0, 0, fluxHop, fluxCount);
+            if (rms && flux && hop == OnsetDetector::kHop && fluxHop == OnsetDetector::kHop) {
+                envelopes.rms.assign(rms, rms + rmsCount);
+                envelopes.flux.assign(flux, flux + fluxCount);
+                onsetDetector.restoreEnvelopes(std::move(envelopes));
+            }
+        }
+        sidecarHasEnvelopes = onsetDetector.hasEnvelopes();
+        sidecarMarkersVersion = markers.getVersion();
+        if (audioProcessor->hasCachedPeaks()) {
+            printf("Loaded peaks from sidecar\n");
+        }
         return true;
     }
 
-    void saveMarkersToCsv() {
-        // Construct CSV filename (same base name as WAV file)
-        std::string csvFilename = std::string(currentWavFile.c_str());
-        size_t dotPos = csvFilename.find_last_of('.');
-        if (dotPos != std::string::npos) {
-            csvFilename = csvFilename.substr(0, dotPos) + ".csv";
-        }
-
-        // Open file for writing
-        std::ofstream csvFile(csvFilename);
-        if (csvFile.is_open()) {
-            // Write each marker
-            for (const auto& marker : marks) {
-                if (marker.end == 0) {
-                    csvFile << marker.sample << "," << marker.intensity << "\n";
-                } else {
-                    csvFile << marker.sample << "," << marker.intensity << "," << marker.end << "\n";
-                }
-            }
-            
-            printf("Saved %zu markers to CSV: %s\n", marks.size(), csvFilename.c_str());
-        } else {
-            printf("Failed to open CSV for writing: %s\n", csvFilename.c_str());
-        }
+    // Records the finished section drag, a selected section stays selected
+    // under its new bounds
+    void commitSectionDrag() {
+        history.commitDrag(dragOrigin, dragCurrent);
+        if (selectedMarks.erase(dragOrigin)) selectedMarks.insert(dragCurrent);
+        draggedSection = -1;
     }
 
-    void cleanup() {
+    // Saves everything of the current file and forgets its per-file state
+    void closeFile() {
+        if (!audioProcessor) return;
+        // A drag in progress is committed as it stands
+        if (draggedSection >= 0) commitSectionDrag();
+        // Flush pending marker edits and fold them into the CSV
+        journal.close();
+        onsetDetector.cancel();
+        saveSidecar();
+        onsetDetector.reset();
+        sectionStats.reset();
+
         // Close audio device during cleanup
-        if (audioDevice != 0) {
-            SDL_CloseAudioDevice(audioDevice);
-        }
+        player.close();
+        // Textures go while the GL context still exists
+        spectrogram->clear();
+        spectrogram.reset();
+        for (auto& waveform : waveforms) waveform.clear();
+        waveforms.clear();
+        gpuWaveform.clear();
+        // The session keeps the audio itself
+        audioProcessor.reset();
 
-        // Existing cleanup code...
-        ImGui_ImplOpenGL3_Shutdown();
-        ImGui_ImplSDL2_Shutdown();
-        ImPlot::DestroyContext();
-        ImGui::DestroyContext();
-        SDL_GL_DeleteContext(glContext);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+        markers.clear();
+        history.clear();
+        suggestions.clear();
+        selectedMarks.clear();
+        selectionAnchor = -1;
+        scrollToRow = -1;
+        listRowsVersion = UINT64_MAX;
+        heldSection = -1;
+        lastHeldSection = -1;
+        section_mark = 0;
+        tailGrown = false;
+        plotXMin = 0.0;
+        plotXMax = 10000.0;
+    }
+
+    void switchFile(size_t index) {
+        if (index >= session.size() || index == session.getCurrent()) return;
+        size_t previous = session.getCurrent();
+        closeFile();
+        if (!openFile(index) && !openFile(previous)) {
+            printf("Cannot reopen %s\n", session.getFile(previous).c_str());
+        }
     }
 
     void render() {
+        if (pendingFile >= 0) {
+            switchFile((size_t)pendingFile);
+            pendingFile = -1;
+        }
+        perfHud.endFrame();
+        PROFILE_SCOPE("frame");
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
         ImGui::NewFrame();
+        // Peaks the loader finished since the last frame
+        gpuWaveform.update(*audioProcessor);
 
         ImGui::SetNextWindowPos(ImVec2(0, 0));
         ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize, ImGuiCond_Always);
@@ -167,62 +232,296 @@ public:
 
 
         ImGui::BeginChild("plot", ImVec2(ImGui::GetContentRegionAvail().x, ImGui::GetContentRegionAvail().y * 0.4), true);
-        auto samples = audioProcessor.getSamples();
-        static size_t base_sample = 0;
-        if (ImPlot::BeginPlot("##Waveform", ImVec2(-1, -1))) {
-            // no zoom
-            // ImPlot::SetupAxisZoomConstraints(ImAxis_X1, 1.0, INFINITY);
-            ImPlot::SetupAxisZoomConstraints(ImAxis_Y1, 1.0, 1.0);
-            ImPlot::SetupAxisLimitsConstraints(ImAxis_X1, 0, samples.size());
-            ImPlot::SetupAxes("Sample Number", "Amplitude");
-            ImPlot::SetupAxisLimits(ImAxis_X1, 0, 10000, ImGuiCond_Once);
-            ImPlot::SetupAxisLimits(ImAxis_Y1, -1, 1, ImGuiCond_Once);
+        // Frames appended to a followed file are decoded in a blink, only
+        // the first pass gets a progress bar
+        if (!audioProcessor->isLoaded() && !tailGrown) {
+            char progressLabel[64];
+            snprintf(progressLabel, sizeof(progressLabel), "Loading %.0f%%", audioProcessor->getLoadProgress() * 100.0f);
+            ImGui::ProgressBar(audioProcessor->getLoadProgress(), ImVec2(-1, 0), progressLabel);
+        }
 
-            auto limits = ImPlot::GetPlotLimits();
+        // One stacked plot per channel, sharing the X axis and the markers,
+        // and the spectrogram below them
+        size_t numChannels = std::max<size_t>(audioProcessor->getNumChannels(), 1);
+        float availableHeight = ImGui::GetContentRegionAvail().y;
+        float spectrogramHeight = showSpectrogram ? availableHeight * 0.4f : 0.0f;
+        float plotHeight = (availableHeight - spectrogramHeight) / numChannels;
+        lastHeldSection = heldSection;
+        heldSection = -1;
+        {
+            PROFILE_SCOPE("waveform plots");
+            for (size_t channel = 0; channel < numChannels; ++channel) {
+                renderWaveformPlot(channel, plotHeight);
+            }
+        }
+        if (showSpectrogram) {
+            renderSpectrogramPlot(spectrogramHeight);
+        }
+        // A section drag ends once no plot holds it anymore
+        if (draggedSection >= 0 && heldSection != draggedSection) commitSectionDrag();
 
+        ImGui::EndChild();
+
+        ImGui::BeginChild("ControlPanel", ImVec2(ImGui::GetContentRegionAvail().x, 200), true);
 
-            size_t minX = static_cast<size_t>(limits.X.Min);
-            size_t maxX = static_cast<size_t>(limits.X.Max);
-            auto total_samples = maxX - minX;
-            base_sample = minX;
-            if (base_sample > samples.size()) {
-                base_sample = samples.size() -1;
-                total_samples = 0;
-            } else if (samples.size() < maxX) {
-                total_samples = samples.size() - minX;
+        // Split the child window into two columns
+        ImGui::Columns(2, "ControlColumns", true);
+        
+        // Left column - List of rows
+        ImGui::SetColumnWidth(0, ImGui::GetWindowWidth() * 0.7f);
+        {
+            ImGui::Text("Markers");
+            ImGui::Separator();
+            
+            renderMarkerList();
+        }
+        
+        // Right column - Dropdown and additional controls
+        ImGui::NextColumn();
+        {
+            const char* intensityLevels[] = {"Low", "Med", "High", "Very High"};
+            
+            // Dropdown for intensity
+            ImGui::Text("Intensity Level");
+            if (ImGui::BeginCombo("##Intensity", intensityLevels[currentIntensity])) {
+                for (int n = 0; n < 4; n++) {
+                    bool is_selected = (currentIntensity == n);
+                    if (ImGui::Selectable(intensityLevels[n], is_selected)) {
+                        currentIntensity = n;
+                    }
+                    if (is_selected) {
+                        ImGui::SetItemDefaultFocus();
+                    }
+                }
+                ImGui::EndCombo();
             }
             
-            auto downsampledData = samples.data() + base_sample;
+            // Keyboard shortcuts for intensity
+            ImGuiIO& io = ImGui::GetIO();
+            if (io.KeysDown[ImGuiKey_1]) currentIntensity = 0;
+            if (io.KeysDown[ImGuiKey_2]) currentIntensity = 1;
+            if (io.KeysDown[ImGuiKey_3]) currentIntensity = 2;
+            if (io.KeysDown[ImGuiKey_4]) currentIntensity = 3;
 
+            renderUndoRedo();
+            renderFileSwitcher();
+            renderTransport();
+            renderSectionStats();
+            ImGui::Checkbox("Spectrogram", &showSpectrogram);
+            bool showHud = perfHud.isVisible();
+            if (ImGui::Checkbox("Performance (F3)", &showHud)) perfHud.setVisible(showHud);
+            renderSuggestions();
+        }
+        
+        ImGui::Columns(1);
+        ImGui::EndChild();
 
-            auto getter = [](int idx, void* data) -> ImPlotPoint {
-                float* samples = (float*)(data);
-                // pointer arythmetics FTW
-                float y = *(samples + idx);
-                return ImPlotPoint(idx+base_sample, y);
-            };
 
-            ImPlot::PlotLineG("Waveform", getter, downsampledData, total_samples, 0.0);
+        ImGui::End();
+
+        if (ImGui::IsKeyPressed(ImGuiKey_F3, false)) perfHud.setVisible(!perfHud.isVisible());
+        perfHud.draw();
+
+        {
+            PROFILE_SCOPE("imgui render");
+            ImGui::Render();
+        }
+        {
+            PROFILE_SCOPE("gl render");
+            glViewport(0, 0, windowWidth, windowHeight);
+            glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        {
+            PROFILE_SCOPE("swap");
+            SDL_GL_SwapWindow(window);
+        }
+    }
+
+    // False once the window is closed. redraw tells whether a frame is due:
+    // input, a grown file or work in progress, not a bare idle timeout.
+    bool handleEvents(bool& redraw) {
+        // Spectrogram tiles that covered the old end are computed again
+        size_t tailFrom = audioProcessor->getNumSamples();
+        if (audioProcessor->pollTail()) {
+            spectrogram->invalidateFrom(tailFrom);
+            tailGrown = true;
+            settleFrames = kSettleFrames;
+        }
+
+        // Nothing moves on screen, so sleep until input arrives instead of
+        // redrawing the same frame
+        SDL_Event event;
+        redraw = needsRedraw();
+        if (!redraw) {
+            PROFILE_SCOPE("idle");
+            // Text fields still get a frame now and then for the cursor blink,
+            // a followed file is checked for new frames
+            bool textInput = ImGui::GetIO().WantTextInput;
+            int timeout = textInput ? kTextInputWaitMs : kIdleWaitMs;
+            if (audioProcessor->isTailing()) timeout = std::min(timeout, AudioProcessor::kTailPollMs);
+            if (SDL_WaitEventTimeout(&event, timeout)) {
+                if (!processEvent(event)) return false;
+                redraw = true;
+            }
+            redraw = redraw || textInput;
+        }
+        PROFILE_SCOPE("events");
+        while (SDL_PollEvent(&event)) {
+            if (!processEvent(event)) return false;
+            redraw = true;
+        }
+        return true;
+    }
+
+private:
+    SDL_Window* window = nullptr;
+    SDL_GLContext glContext = nullptr;
+    AudioPlayer player;
+    bool loopSections = true;
+    int windowWidth, windowHeight;
+    size_t section_mark = 0;
+    // Workers of the spectrogram and the analyses, shared so together they
+    // leave a core to the UI and the audio feeder
+    ThreadPool analysisPool{ThreadPool::backgroundThreads()};
+    // Files of the run and the audio kept for them, the current file's
+    // audio and spectrogram are swapped on a switch
+    Session session;
+    std::shared_ptr<AudioProcessor> audioProcessor;
+    std::unique_ptr<Spectrogram> spectrogram;
+    // File picked in the switcher, opened before the next frame
+    int pendingFile = -1;
+    bool showSpectrogram = true;
+    // A followed file has grown since it was opened
+    bool tailGrown = false;
+    // Frames still drawn after the last input or background work
+    static constexpr int kSettleFrames = 3;
+    static constexpr int kIdleWaitMs = 500;
+    static constexpr int kTextInputWaitMs = 50;
+    int settleFrames = kSettleFrames;
+    // Cached waveform line per channel, for views the GPU path leaves out
+    std::vector<WaveformLayer> waveforms;
+    // Peaks of every channel on the GPU, drawn by a shader
+    GpuWaveform gpuWaveform;
+    // X range shared by every waveform plot
+    double plotXMin = 0.0;
+    double plotXMax = 10000.0;
+    // Section held by the mouse this frame and the last one, and its value
+    int heldSection = -1;
+    int lastHeldSection = -1;
+    Marker heldValue{};
+    // At most this many section drag handles exist at once
+    static constexpr size_t kMaxSectionHandles = 8;
+    static constexpr double kSectionGrabPixels = 6.0;
+    int currentIntensity = 0;
+    MarkerStore markers;
+    MarkerBatch markerBatch;
+    // Onset proposals, drawn faded until accepted into markers
+    OnsetDetector onsetDetector{analysisPool};
+    // Level sums of the file, section statistics are read off them
+    SectionStats sectionStats{analysisPool};
+    PerfHud perfHud;
+    MarkerStore suggestions;
+    MarkerBatch suggestionBatch;
+    // What the sidecar read at startup covered, to skip rewriting it
+    bool sidecarCurrent = false;
+    bool sidecarHasEnvelopes = false;
+    uint64_t sidecarMarkersVersion = 0;
+    // Marker list panel state
+    enum { FilterAll, FilterPoints, FilterSections, FilterLow };
+    int listFilter = FilterAll;
+    std::vector<Marker> listRows;
+    uint64_t listRowsVersion = UINT64_MAX;
+    int listRowsFilter = -1;
+    std::set<Marker, MarkerLess> selectedMarks;
+    int selectionAnchor = -1;
+    int scrollToRow = -1;
+    char searchText[64] = "";
+    MarkerJournal journal;
+    // Every marker edit goes through here, to the store, the journal and undo
+    MarkerHistory history{markers, journal};
+    // Section being dragged, by id, and its value before and during the drag
+    int draggedSection = -1;
+    Marker dragOrigin{};
+    Marker dragCurrent{};
+    std::string currentWavFile;
+    const char* intensityLevels[4] = {"Low", "Med", "High", "Very High"};
+
+    bool processEvent(const SDL_Event& event) {
+        ImGui_ImplSDL2_ProcessEvent(&event);
+        // ImGui reacts to input over a few frames, hover and popups settle
+        // a frame after the click that caused them
+        settleFrames = kSettleFrames;
+        if (event.type == SDL_QUIT)
+            return false;
+        if (event.type == SDL_WINDOWEVENT &&
+            event.window.event == SDL_WINDOWEVENT_RESIZED) {
+            windowWidth = event.window.data1;
+            windowHeight = event.window.data2;
+        }
+        return true;
+    }
+
+    // Something changes on screen without input: playback, loading,
+    // background analysis or the overlay's graphs
+    bool needsRedraw() {
+        bool busy = player.isPlaying() || !audioProcessor->isLoaded() || spectrogram->isBusy() ||
+            onsetDetector.isRunning() || sectionStats.isRunning() || perfHud.isVisible();
+        // A job that just finished still has its result to show
+        if (busy) settleFrames = std::max(settleFrames, kSettleFrames);
+        if (settleFrames > 0) {
+            settleFrames--;
+            return true;
+        }
+        return false;
+    }
+
+    void renderWaveformPlot(size_t channel, float height) {
+        ImGui::PushID((int)channel);
+        if (ImPlot::BeginPlot("##Waveform", ImVec2(-1, height))) {
+            // no zoom
+            // ImPlot::SetupAxisZoomConstraints(ImAxis_X1, 1.0, INFINITY);
+            ImPlot::SetupAxisZoomConstraints(ImAxis_Y1, 1.0, 1.0);
+            ImPlot::SetupAxisLimitsConstraints(ImAxis_X1, 0, audioProcessor->getNumSamples());
+            char channelLabel[32];
+            snprintf(channelLabel, sizeof(channelLabel), "Channel %zu", channel + 1);
+            ImPlot::SetupAxes("Sample Number", audioProcessor->getNumChannels() > 1 ? channelLabel : "Amplitude");
+            ImPlot::SetupAxisLinks(ImAxis_X1, &plotXMin, &plotXMax);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, -1, 1, ImGuiCond_Once);
+
+            auto limits = ImPlot::GetPlotLimits();
+            size_t minX = static_cast<size_t>(std::max(limits.X.Min, 0.0));
+            size_t maxX = static_cast<size_t>(std::max(std::ceil(limits.X.Max), 0.0)) + 1;
+            ImVec4 waveformColor = ImPlot::GetColormapColor(0);
+            if (!gpuWaveform.draw(*audioProcessor, channel, waveformColor)) {
+                waveforms[channel].draw(*audioProcessor, channel, waveformColor);
+            }
 
             auto mousePosX = (size_t)std::floor(ImPlot::GetPlotMousePos().x);
             double mousePosDouble = double(mousePosX);
+            // Markers can only be placed where the audio is already loaded
+            size_t editableSamples = audioProcessor->getLoadedSamples();
             // Handle plot interactions
             if (ImPlot::IsPlotHovered()) {
                 ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(1.0f, 0.0f, 0.0f, 1.0f));
-		        ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
+                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
                 ImPlot::PlotInfLines("audio marks", &mousePosDouble, 1);
                 ImPlot::PopStyleColor();
                 ImPlot::PopStyleVar();
                 if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && ImGui::IsKeyDown(ImGuiKey_LeftCtrl)) {
-                    if (mousePosX > 0 && mousePosX < audioProcessor.getNumSamples()) {
+                    if (mousePosX > 0 && mousePosX < editableSamples) {
                         insertMarkSorted(mousePosX, currentIntensity);
                     }
                 }
                 if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && ImGui::IsKeyDown(ImGuiKey_LeftAlt)) {
-                    if (mousePosX > 0 && mousePosX < audioProcessor.getNumSamples()) {
+                    if (mousePosX > 0 && mousePosX < editableSamples) {
                         insertSectionSorted(mousePosX, -1);
                     }
                 }
+                if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && ImGui::IsKeyDown(ImGuiKey_LeftShift)) {
+                    player.seek(std::min(mousePosX, audioProcessor->getNumSamples()));
+                }
                 if (ImGui::IsKeyDown(ImGuiKey_Escape)) {
                     // cancel selection
                     section_mark = 0;
@@ -230,52 +529,89 @@ public:
             }
 
             ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(0.0f, 1.0f, 0.0f, 1.0f));
-		    ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
-            std::vector<double> temp_marks;
-            std::vector<ImVec4> mark_colors;
-            temp_marks.reserve(marks.size());
-            mark_colors.reserve(marks.size());
-            int i = 0;
-            for (auto& mark : marks) {
-                if (mark.end == 0) {
-                    temp_marks.push_back(static_cast<double>(mark.sample));
-                    mark_colors.push_back(intensityColors[mark.intensity]);
-                } else {
-                    //FIXME: should crash because it will be writing memory to the stack when changed
-                    double start = (double) mark.sample;
-                    double end = (double) mark.end;
-                    double prev_start = start;
-                    double prev_end = end;
-                    bool clicked = false, hovered = false, held = false;
-                    ImVec4 color(1.0f, 0.0f, 0.0f, 0.5f); // Red, 50%
-                    ImPlot::DragRect(i, &start, &limits.Y.Min, &end, &limits.Y.Max, color, ImPlotDragToolFlags_None, &clicked, &hovered, &held);
-                    if (held) {
-                        if (prev_start != start || prev_end != end) {
-                            double min, max = 0.0;
-                            if (start < end) {
-                                min = std::max(start, 0.0);
-                                max = std::min(end, (double) audioProcessor.getNumSamples());
-                            } else {
-                                min = std::max(end, 0.0);
-                                max = std::min(start, (double) audioProcessor.getNumSamples());
-                            }
-                            mark.sample = min;
-                            mark.end = max;
-                            needsSectionsUpdate = i;
+            ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
+            // Only the markers inside the visible range are looked at, one
+            // plot item per intensity and one line per pixel column
+            float plotWidth = std::max(ImPlot::GetPlotSize().x, 1.0f);
+            double samplesPerPixel = (limits.X.Max - limits.X.Min) / plotWidth;
+            {
+                PROFILE_SCOPE("marker drawing");
+                buildMarkerBatch(markers, minX, maxX, samplesPerPixel, markerBatch);
+                renderMarkerBatch(markerBatch, samplesPerPixel);
+                if (!suggestions.empty()) {
+                    buildMarkerBatch(suggestions, minX, maxX, samplesPerPixel, suggestionBatch);
+                    renderMarkerBatch(suggestionBatch, samplesPerPixel, true);
+                }
+            }
+
+            // Sections are drawn by the batch, drag handles only exist for the
+            // ones under the mouse and the one being held
+            std::vector<size_t> handles;
+            int activeSection = heldSection >= 0 ? heldSection : lastHeldSection;
+            if (activeSection >= 0) {
+                markers.forEachSectionIn(heldValue.sample, heldValue.end, [&](size_t index, const Marker&) {
+                    if (markers.sectionId(index) == activeSection) handles.push_back(index);
+                });
+            }
+            if (ImPlot::IsPlotHovered()) {
+                double grab = samplesPerPixel * kSectionGrabPixels;
+                size_t grabFrom = (size_t)std::max(ImPlot::GetPlotMousePos().x - grab, 0.0);
+                size_t grabTo = (size_t)std::max(ImPlot::GetPlotMousePos().x + grab, 0.0);
+                markers.forEachSectionIn(grabFrom, grabTo, [&](size_t index, const Marker&) {
+                    if (handles.size() < kMaxSectionHandles && markers.sectionId(index) != activeSection) {
+                        handles.push_back(index);
+                    }
+                });
+            }
+
+            // A dragged section may move in the store, so the edit waits for the walk to end
+            bool sectionMoved = false;
+            bool sectionHeld = false;
+            size_t movedIndex = 0, movedStart = 0, movedEnd = 0;
+            for (size_t index : handles) {
+                const Marker& mark = markers.section(index);
+                int id = markers.sectionId(index);
+                //FIXME: should crash because it will be writing memory to the stack when changed
+                double start = (double) mark.sample;
+                double end = (double) mark.end;
+                double prev_start = start;
+                double prev_end = end;
+                bool clicked = false, hovered = false, held = false;
+                ImVec4 color(1.0f, 0.0f, 0.0f, 0.5f); // Red, 50%
+                ImPlot::DragRect(id, &start, &limits.Y.Min, &end, &limits.Y.Max, color, ImPlotDragToolFlags_None, &clicked, &hovered, &held);
+                if (held) {
+                    heldSection = id;
+                    heldValue = mark;
+                    sectionHeld = true;
+                    if (prev_start != start || prev_end != end) {
+                        double min, max = 0.0;
+                        if (start < end) {
+                            min = std::max(start, 0.0);
+                            max = std::min(end, (double) editableSamples);
+                        } else {
+                            min = std::max(end, 0.0);
+                            max = std::min(start, (double) editableSamples);
+                        }
+                        if (draggedSection != id) {
+                            // Journaled as one edit once the drag ends
+                            dragOrigin = mark;
                         }
-                    } else if (needsSectionsUpdate == i) {
-                        saveMarkersToCsv();
-                        needsSectionsUpdate = -1;
+                        sectionMoved = true;
+                        movedIndex = index;
+                        movedStart = min;
+                        movedEnd = max;
+                        draggedSection = id;
                     }
                 }
-                i++;
             }
-            for (size_t i = 0; i < temp_marks.size(); ++i) {
-                ImPlot::PushStyleColor(ImPlotCol_Line, mark_colors[i]);
-                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 1);
-                ImPlot::PlotInfLines("audio marks", &temp_marks[i], 1);
-                ImPlot::PopStyleColor();
-                ImPlot::PopStyleVar();
+            if (sectionMoved) {
+                size_t newIndex = markers.modifySection(movedIndex, movedStart, movedEnd);
+                dragCurrent = markers.section(newIndex);
+                heldValue = dragCurrent;
+            }
+            // Follows the section while it is dragged
+            if (sectionHeld) {
+                renderSectionTooltip(heldValue);
             }
             if (section_mark != 0) {
                 ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(1.0f, 0.0f, 0.0f, 0.5f));
@@ -285,168 +621,321 @@ public:
                 ImPlot::PopStyleColor();
                 ImPlot::PopStyleVar();
             }
+            if (player.isOpen()) {
+                ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(1.0f, 1.0f, 1.0f, 1.0f));
+                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 2);
+                double playhead = player.getPlayhead();
+                ImPlot::PlotInfLines("playhead", &playhead, 1);
+                ImPlot::PopStyleColor();
+                ImPlot::PopStyleVar();
+            }
             ImPlot::PopStyleColor();
-		    ImPlot::PopStyleVar();
+            ImPlot::PopStyleVar();
             ImPlot::EndPlot();
         }
+        ImGui::PopID();
+    }
 
-        ImGui::EndChild();
+    // Frequency content under the waveforms, same X range and markers
+    void renderSpectrogramPlot(float height) {
+        PROFILE_SCOPE("spectrogram");
+        if (ImPlot::BeginPlot("##Spectrogram", ImVec2(-1, height), ImPlotFlags_NoLegend)) {
+            double nyquist = audioProcessor->getSampleRate() / 2.0;
+            ImPlot::SetupAxes("Sample Number", "Frequency (Hz)");
+            ImPlot::SetupAxisLimitsConstraints(ImAxis_X1, 0, audioProcessor->getNumSamples());
+            ImPlot::SetupAxisLinks(ImAxis_X1, &plotXMin, &plotXMax);
+            ImPlot::SetupAxisLimits(ImAxis_Y1, 0, nyquist, ImGuiCond_Always);
 
-        ImGui::BeginChild("ControlPanel", ImVec2(ImGui::GetContentRegionAvail().x, 200), true);
+            auto limits = ImPlot::GetPlotLimits();
+            float plotWidth = std::max(ImPlot::GetPlotSize().x, 1.0f);
+            spectrogram->draw(limits.X.Min, limits.X.Max, plotWidth);
 
-        // Split the child window into two columns
-        ImGui::Columns(2, "ControlColumns", true);
-        
-        // Left column - List of rows
-        ImGui::SetColumnWidth(0, ImGui::GetWindowWidth() * 0.7f);
-        {
-            ImGui::Text("Markers");
-            ImGui::Separator();
-            
-            // Scrollable list of markers
-            ImGui::BeginChild("MarkerList", ImVec2(0, 150), true);
-            for (size_t i = 0; i < marks.size(); ++i) {
-                ImGui::PushID(i);
-                
-                ImGui::Text("Sample %zu", marks[i].sample);
+            // The waveform plots already batched the markers for this range
+            double samplesPerPixel = (limits.X.Max - limits.X.Min) / plotWidth;
+            renderMarkerBatch(markerBatch, samplesPerPixel);
+            if (!suggestions.empty()) renderMarkerBatch(suggestionBatch, samplesPerPixel, true);
+            if (player.isOpen()) {
+                ImPlot::PushStyleColor(ImPlotCol_Line, ImVec4(1.0f, 1.0f, 1.0f, 1.0f));
+                ImPlot::PushStyleVar(ImPlotStyleVar_LineWeight, 2);
+                double playhead = player.getPlayhead();
+                ImPlot::PlotInfLines("playhead", &playhead, 1);
+                ImPlot::PopStyleColor();
+                ImPlot::PopStyleVar();
+            }
+            ImPlot::EndPlot();
+        }
+    }
+
+    // Filter, search box and a clipped list, only the visible rows are
+    // submitted so the panel costs the same with ten or a million markers
+    void renderMarkerList() {
+        PROFILE_SCOPE("marker list");
+        const char* filterNames[] = {"All", "Points", "Sections", "Low", "Med", "High", "Very High"};
+        ImGui::SetNextItemWidth(120);
+        ImGui::Combo("##Filter", &listFilter, filterNames, IM_ARRAYSIZE(filterNames));
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200);
+        if (ImGui::InputTextWithHint("##Search", "sample or m:ss.sss", searchText, sizeof(searchText),
+                ImGuiInputTextFlags_EnterReturnsTrue)) {
+            jumpToSearch();
+        }
+        ImGui::SameLine();
+        ImGui::BeginDisabled(selectedMarks.empty());
+        char deleteLabel[64];
+        snprintf(deleteLabel, sizeof(deleteLabel), "Delete selected (%zu)", selectedMarks.size());
+        bool deleteSelected = ImGui::Button(deleteLabel);
+        ImGui::EndDisabled();
+
+        updateListRows();
+
+        // Scrollable list of markers
+        ImGui::BeginChild("MarkerList", ImVec2(0, 0), true);
+        if (ImGui::IsWindowFocused() && ImGui::IsKeyPressed(ImGuiKey_Delete, false)) {
+            deleteSelected = true;
+        }
+        // Deletions are collected and applied after the list is drawn
+        std::vector<Marker> toDelete;
+        ImGuiIO& io = ImGui::GetIO();
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)listRows.size());
+        if (scrollToRow >= 0 && scrollToRow < (int)listRows.size()) {
+            clipper.IncludeItemByIndex(scrollToRow);
+        }
+        while (clipper.Step()) {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                const Marker& mark = listRows[row];
+                ImGui::PushID(row);
+
+                bool selected = selectedMarks.count(mark) > 0;
+                if (ImGui::Selectable("##row", selected, ImGuiSelectableFlags_AllowOverlap,
+                        ImVec2(0, ImGui::GetFrameHeight()))) {
+                    selectRow(row, io.KeyCtrl, io.KeyShift);
+                }
+                if (row == scrollToRow) {
+                    ImGui::SetScrollHereY();
+                    scrollToRow = -1;
+                }
+                ImGui::SameLine();
+                char timeText[32];
+                formatTime(mark.sample, timeText, sizeof(timeText));
+                ImGui::Text("Sample %zu (%s)", mark.sample, timeText);
                 ImGui::SameLine(ImGui::GetWindowWidth() * 0.4f);
-                if (marks[i].intensity >= 0 ) {
+                if (mark.intensity >= 0 ) {
                     ImGui::TextColored(
-                        intensityColors[marks[i].intensity], 
+                        kIntensityColors[mark.intensity], 
                         "%s", 
-                        intensityLevels[marks[i].intensity]
+                        intensityLevels[mark.intensity]
                     );
                 } else {
-                    ImGui::Text("end %zu", marks[i].end);
+                    ImGui::Text("end %zu", mark.end);
+                    if (ImGui::IsItemHovered()) {
+                        renderSectionTooltip(mark);
+                    }
                 }
                 ImGui::SameLine(ImGui::GetWindowWidth() * 0.6f);
                 
                 if (ImGui::Button("Play")) {
                     // Play audio from this marker
-                    playAudioSegment(marks[i].sample);
+                    playMarker(mark);
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("See")) {
-                    printf("See marker %zu\n", i);
+                    centerPlotOn(mark);
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Delete")) {
-                    marks.erase(marks.begin() + i);
-                    i--; // Adjust loop counter
-                    // Save to CSV after deletion
-                    saveMarkersToCsv();
+                    toDelete.push_back(mark);
                 }
                 
                 ImGui::Separator();
                 ImGui::PopID();
             }
-            ImGui::EndChild();
         }
-        
-        // Right column - Dropdown and additional controls
-        ImGui::NextColumn();
-        {
-            const char* intensityLevels[] = {"Low", "Med", "High", "Very High"};
-            
-            // Dropdown for intensity
-            ImGui::Text("Intensity Level");
-            if (ImGui::BeginCombo("##Intensity", intensityLevels[currentIntensity])) {
-                for (int n = 0; n < 4; n++) {
-                    bool is_selected = (currentIntensity == n);
-                    if (ImGui::Selectable(intensityLevels[n], is_selected)) {
-                        currentIntensity = n;
-                    }
-                    if (is_selected) {
-                        ImGui::SetItemDefaultFocus();
-                    }
-                }
-                ImGui::EndCombo();
-            }
-            
-            // Keyboard shortcuts for intensity
-            ImGuiIO& io = ImGui::GetIO();
-            if (io.KeysDown[ImGuiKey_1]) currentIntensity = 0;
-            if (io.KeysDown[ImGuiKey_2]) currentIntensity = 1;
-            if (io.KeysDown[ImGuiKey_3]) currentIntensity = 2;
-            if (io.KeysDown[ImGuiKey_4]) currentIntensity = 3;
-        }
-        
-        ImGui::Columns(1);
+        clipper.End();
         ImGui::EndChild();
 
+        if (deleteSelected) {
+            toDelete.insert(toDelete.end(), selectedMarks.begin(), selectedMarks.end());
+            selectedMarks.clear();
+            selectionAnchor = -1;
+        }
+        if (!toDelete.empty()) {
+            // A row may be both selected and deleted on its own
+            std::sort(toDelete.begin(), toDelete.end(), MarkerLess());
+            toDelete.erase(std::unique(toDelete.begin(), toDelete.end()), toDelete.end());
+            history.eraseAll(std::move(toDelete));
+        }
+    }
 
-        ImGui::End();
+    // Rows shown for the current filter, rebuilt only when the store changed
+    void updateListRows() {
+        if (listRowsVersion == markers.getVersion() && listRowsFilter == listFilter) return;
+        listRowsVersion = markers.getVersion();
+        listRowsFilter = listFilter;
 
-        ImGui::Render();
-        glViewport(0, 0, windowWidth, windowHeight);
-        glClearColor(0.45f, 0.55f, 0.60f, 1.00f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(window);
+        listRows.clear();
+        if (listFilter == FilterAll) {
+            listRows = markers.toVector();
+        } else if (listFilter == FilterSections) {
+            for (size_t i = 0; i < markers.numSections(); ++i) {
+                listRows.push_back(markers.section(i));
+            }
+        } else {
+            int intensity = listFilter - FilterLow;
+            markers.forEachPointIn(0, SIZE_MAX, [&](size_t, const Marker& mark) {
+                if (listFilter == FilterPoints || mark.intensity == intensity) {
+                    listRows.push_back(mark);
+                }
+            });
+        }
     }
 
-    bool handleEvents() {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            ImGui_ImplSDL2_ProcessEvent(&event);
-            if (event.type == SDL_QUIT)
-                return false;
-            if (event.type == SDL_WINDOWEVENT && 
-                event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                windowWidth = event.window.data1;
-                windowHeight = event.window.data2;
+    // Plain click selects one row, ctrl toggles, shift extends from the anchor
+    void selectRow(int row, bool toggle, bool extend) {
+        if (extend && selectionAnchor >= 0 && selectionAnchor < (int)listRows.size()) {
+            if (!toggle) selectedMarks.clear();
+            int from = std::min(row, selectionAnchor);
+            int to = std::max(row, selectionAnchor);
+            selectedMarks.insert(listRows.begin() + from, listRows.begin() + to + 1);
+            return;
+        }
+        if (toggle) {
+            if (!selectedMarks.erase(listRows[row])) {
+                selectedMarks.insert(listRows[row]);
             }
+        } else {
+            selectedMarks.clear();
+            selectedMarks.insert(listRows[row]);
+        }
+        selectionAnchor = row;
+    }
+
+    // Rows are sorted by sample, so the first row at or after the searched
+    // position is a binary search away
+    void jumpToSearch() {
+        size_t sample = 0;
+        if (!parseSampleOrTime(searchText, audioProcessor->getSampleRate(), sample) || listRows.empty()) {
+            return;
+        }
+        auto pos = std::lower_bound(listRows.begin(), listRows.end(), sample,
+            [](const Marker& m, size_t s) { return m.sample < s; });
+        int row = (int)std::min<size_t>(pos - listRows.begin(), listRows.size() - 1);
+        selectedMarks.clear();
+        selectedMarks.insert(listRows[row]);
+        selectionAnchor = row;
+        scrollToRow = row;
+        centerPlotOn(listRows[row]);
+    }
+
+    // Accepts a sample number, seconds ("12.5", "12.5s") or [h:]m:ss[.fff]
+    static bool parseSampleOrTime(const char* text, int sampleRate, size_t& sample) {
+        while (*text == ' ') text++;
+        if (*text == '\0') return false;
+        bool isTime = strchr(text, ':') || strchr(text, '.') || strchr(text, 's');
+        if (!isTime) {
+            char* end = nullptr;
+            unsigned long long value = strtoull(text, &end, 10);
+            if (end == text) return false;
+            sample = (size_t)value;
+            return true;
+        }
+        if (sampleRate <= 0) return false;
+        double seconds = 0.0;
+        const char* p = text;
+        while (true) {
+            char* end = nullptr;
+            double part = strtod(p, &end);
+            if (end == p || part < 0.0) return false;
+            seconds = seconds * 60.0 + part;
+            if (*end != ':') break;
+            p = end + 1;
         }
+        sample = (size_t)std::llround(seconds * sampleRate);
         return true;
     }
 
-private:
-    SDL_Window* window = nullptr;
-    SDL_GLContext glContext = nullptr;
-    SDL_AudioDeviceID audioDevice = 0;
-    std::vector<float> playbackBuffer;
-    bool isPlaying = false;
-    int needsSectionsUpdate = -1;
-    int windowWidth, windowHeight;
-    size_t section_mark = 0;
-    AudioProcessor audioProcessor;
-    int currentIntensity = 0;
-    std::vector<Marker> marks;
-    std::string currentWavFile;
-    const char* intensityLevels[4] = {"Low", "Med", "High", "Very High"};
+    void formatTime(size_t sample, char* out, size_t size) {
+        int sampleRate = audioProcessor->getSampleRate();
+        double seconds = sampleRate > 0 ? (double)sample / sampleRate : 0.0;
+        int minutes = (int)(seconds / 60.0);
+        snprintf(out, size, "%d:%06.3f", minutes, seconds - minutes * 60.0);
+    }
+
+    // Moves the shared X range so mark is in the middle, sections wider
+    // than the view zoom it out to fit
+    void centerPlotOn(const Marker& mark) {
+        double width = plotXMax - plotXMin;
+        double center = (double)mark.sample;
+        if (MarkerStore::isSection(mark)) {
+            center = (mark.sample + mark.end) / 2.0;
+            width = std::max(width, (mark.end - mark.sample) * 1.2);
+        }
+        double total = (double)audioProcessor->getNumSamples();
+        if (total > 0.0) width = std::min(width, total);
+        plotXMin = center - width / 2.0;
+        plotXMax = center + width / 2.0;
+        if (plotXMin < 0.0) {
+            plotXMax -= plotXMin;
+            plotXMin = 0.0;
+        }
+        if (total > 0.0 && plotXMax > total) {
+            plotXMin -= plotXMax - total;
+            plotXMax = total;
+        }
+    }
+
+    // Writes peaks, analysis and the markers as they are in the CSV, unless
+    // the sidecar read at startup already holds all of it
+    void saveSidecar() {
+        bool changed = !sidecarCurrent || markers.getVersion() != sidecarMarkersVersion ||
+            onsetDetector.hasEnvelopes() != sidecarHasEnvelopes;
+        if (!changed || !audioProcessor->isLoaded() || currentWavFile.empty()) return;
 
-    ImVec4 intensityColors[4] = {
-        ImVec4(0.4f, 0.8f, 0.4f, 1.0f),   // blue for Low
-        ImVec4(1.0f, 1.0f, 0.0f, 1.0f),   // Yellow for Med
-        ImVec4(1.0f, 0.5f, 0.0f, 1.0f),   // Orange for High
-        ImVec4(1.0f, 0.0f, 0.0f, 1.0f)    // Red for Very High
-    };
+        SidecarFile::Content content;
+        if (!stampFile(currentWavFile, content.wav)) return;
+        content.numSamples = audioProcessor->getNumSamples();
+        content.sampleRate = audioProcessor->getSampleRate();
+        content.numChannels = audioProcessor->getNumChannels();
+
+        // Markers only go in when they match the CSV byte for byte
+        std::vector<Marker> marks = markers.toVector();
+        if (journal.isCsvCurrent() && stampFile(journal.getCsvPath(), content.csv)) {
+            content.csvHash = journal.getCsvHash();
+            content.markers = &marks;
+        }
+        for (size_t c = 0; c < audioProcessor->getNumChannels(); ++c) {
+            const auto& levels = audioProcessor->getPeakLevels(c);
+            for (size_t l = 0; l < levels.size(); ++l) {
+                content.arrays.push_back({SidecarFile::kTagPeaks, (uint16_t)c, (uint16_t)l,
+                    levels[l].samplesPerBucket, levels[l].peaks.data(), levels[l].peaks.size()});
+            }
+        }
+        if (onsetDetector.hasEnvelopes()) {
+            const OnsetDetector::Envelopes& envelopes = onsetDetector.getEnvelopes();
+            content.arrays.push_back({SidecarFile::kTagRms, 0, 0, OnsetDetector::kHop,
+                envelopes.rms.data(), envelopes.rms.size()});
+            content.arrays.push_back({SidecarFile::kTagFlux, 0, 0, OnsetDetector::kHop,
+                envelopes.flux.data(), envelopes.flux.size()});
+        }
+
+        std::string path = sidecarPath(currentWavFile);
+        if (SidecarFile::write(path, content)) {
+            printf("Saved sidecar: %s\n", path.c_str());
+        }
+    }
 
     void insertMarkSorted(size_t mark, int currentIntensity) {
-        // Find the position where mark should be inserted
-        auto pos = lower_bound(marks.begin(), marks.end(), mark, 
-            [](const Marker& a, size_t b) { return a.sample < b; });
-        
-        // Insert at the found position
-        marks.insert(pos, {mark, currentIntensity});
-        
-        // Save to CSV
-        saveMarkersToCsv();
+        history.insert({mark, currentIntensity, 0});
     }
 
     void insertSectionSorted(size_t mark, int currentIntensity) {
-        // Find the position where mark should be inserted
-        auto pos = lower_bound(marks.begin(), marks.end(), mark, 
-            [](const Marker& a, size_t b) { return a.sample < b; });
         printf("section_mark = %ld\n", section_mark);
         if (section_mark != 0) {
-            // Insert at the found position
             // FIXME: remove marks between section_mark and mark.
             size_t min_number = std::min(mark, section_mark);
             size_t max_number = std::max(mark, section_mark);
-            marks.insert(pos, {min_number, currentIntensity, max_number});
-            // Save to CSV
-            saveMarkersToCsv();
+            history.insert({min_number, currentIntensity, max_number});
             section_mark = 0;
             printf("section marked end\n");
         } else {
@@ -455,60 +944,247 @@ private:
         }
     }
 
-    void initAudioPlayback() {
-        SDL_AudioSpec want, have;
-        SDL_zero(want);
-        want.freq = audioProcessor.getSampleRate();
-        want.format = AUDIO_F32;
-        want.channels = 1;
-        want.samples = 4096;
-        want.callback = nullptr; // We'll use SDL_QueueAudio for streaming
+    // Undo and redo of marker edits, also Ctrl+Z and Ctrl+Y or Ctrl+Shift+Z.
+    // Not while a section is being dragged, the drag becomes a step first.
+    void renderUndoRedo() {
+        ImGuiIO& io = ImGui::GetIO();
+        bool keys = !io.WantTextInput && io.KeyCtrl && draggedSection < 0;
+        bool redoKey = keys && (ImGui::IsKeyPressed(ImGuiKey_Y) || (io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_Z)));
+        bool undoKey = keys && !io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_Z);
 
-        audioDevice = SDL_OpenAudioDevice(
-            nullptr, 0, &want, &have, 
-            SDL_AUDIO_ALLOW_FORMAT_CHANGE
-        );
+        bool changed = false;
+        ImGui::BeginDisabled(!history.canUndo() || draggedSection >= 0);
+        if (ImGui::Button("Undo") || undoKey) changed |= history.undo();
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(!history.canRedo() || draggedSection >= 0);
+        if (ImGui::Button("Redo") || redoKey) changed |= history.redo();
+        ImGui::EndDisabled();
+        if (changed) {
+            // Selected rows may be gone
+            selectedMarks.clear();
+            selectionAnchor = -1;
+        }
+    }
 
-        if (audioDevice == 0) {
-            printf("Failed to open audio device: %s\n", SDL_GetError());
+    // Previous/next and a list of the session's files, Page Up and Page Down
+    // switch too. The switch happens before the next frame so nothing drawn
+    // this frame loses its textures.
+    void renderFileSwitcher() {
+        if (session.size() < 2) return;
+        ImGui::Separator();
+        size_t current = session.getCurrent();
+        ImGuiIO& io = ImGui::GetIO();
+        ImGui::BeginDisabled(current == 0);
+        if (ImGui::Button("Prev") || (current > 0 && !io.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_PageUp, false))) {
+            pendingFile = (int)current - 1;
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(current + 1 >= session.size());
+        if (ImGui::Button("Next") ||
+                (current + 1 < session.size() && !io.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_PageDown, false))) {
+            pendingFile = (int)current + 1;
         }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::Text("%zu / %zu", current + 1, session.size());
+
+        std::string name = fs::path(session.getFile(current)).filename().string();
+        if (ImGui::BeginCombo("##File", name.c_str())) {
+            for (size_t i = 0; i < session.size(); ++i) {
+                std::string label = fs::path(session.getFile(i)).filename().string();
+                ImGui::PushID((int)i);
+                if (ImGui::Selectable(label.c_str(), i == current)) pendingFile = (int)i;
+                ImGui::PopID();
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::TextDisabled("Cache %zu / %zu MB, %zu files open",
+            session.getUsedBytes() >> 20, session.getBudget() >> 20, session.getOpenFiles());
     }
 
-    void playAudioSegment(size_t startSample) {
-        // Stop any ongoing playback
-        if (isPlaying) {
-            SDL_PauseAudioDevice(audioDevice, 1);
-            SDL_ClearQueuedAudio(audioDevice);
+    // Play/pause, playhead time and the loop toggle. Space toggles
+    // playback unless a text field has the keyboard.
+    void renderTransport() {
+        ImGui::Separator();
+        if (!player.isOpen()) {
+            ImGui::TextDisabled("No audio device");
+            return;
+        }
+        ImGuiIO& io = ImGui::GetIO();
+        bool toggle = ImGui::Button(player.isPlaying() ? "Pause" : "Play");
+        if (!io.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_Space, false)) {
+            toggle = true;
+        }
+        if (toggle) {
+            if (player.isPlaying()) {
+                player.pause();
+            } else {
+                if (player.getPlayhead() >= audioProcessor->getNumSamples()) player.seek(0);
+                player.play();
+            }
+        }
+        ImGui::SameLine();
+        char timeText[32];
+        formatTime((size_t)player.getPlayhead(), timeText, sizeof(timeText));
+        ImGui::Text("%s", timeText);
+        if (ImGui::Checkbox("Loop sections", &loopSections) && !loopSections) {
+            player.setLoop(0, 0);
         }
 
-        // Get samples from AudioProcessor
-        auto samples = audioProcessor.getSamples();
-        
-        // Ensure we don't overflow
-        size_t segmentLength = 2000;
-        size_t endSample = std::min(startSample + segmentLength, samples.size());
-        
-        // Create playback buffer
-        playbackBuffer.clear();
-        playbackBuffer.insert(
-            playbackBuffer.begin(), 
-            samples.begin() + startSample, 
-            samples.begin() + endSample
-        );
-
-        // Queue audio
-        SDL_QueueAudio(audioDevice, playbackBuffer.data(), 
-            playbackBuffer.size() * sizeof(float));
-        
-        // Start playback
-        SDL_PauseAudioDevice(audioDevice, 0);
-        isPlaying = true;
+        // Stop at the end of the file instead of playing silence
+        if (player.isPlaying() && !player.isLooping() &&
+                player.getPlayhead() >= audioProcessor->getNumSamples()) {
+            player.pause();
+        }
+    }
+
+    // Level statistics of a section, shown while it is hovered in the list or
+    // held in a plot once the stats pass is done
+    void renderSectionTooltip(const Marker& section) {
+        if (!sectionStats.isReady()) return;
+        SectionStats::Stats stats = sectionStats.compute(section.sample, section.end + 1);
+        ImGui::SetTooltip("Duration %.3f s\nPeak %.1f dBFS\nRMS %.1f dBFS\nCrest %.1f dB\n"
+            "Zero crossings %.0f /s\nLoudness %.1f LUFS",
+            stats.duration, stats.peakDb, stats.rmsDb, stats.crestDb, stats.zeroCrossingRate, stats.loudness);
+    }
+
+    // Starts the stats pass when the sections need it, shows its progress and
+    // exports every section's statistics next to the WAV
+    void renderSectionStats() {
+        // Sums are taken once the file is in and extended after a followed
+        // file grew, the tooltips keep the old ones meanwhile
+        sectionStats.update();
+        bool stale = sectionStats.getNumSamples() != audioProcessor->getNumSamples();
+        if (stale && !sectionStats.isRunning() && markers.numSections() > 0 && audioProcessor->isLoaded()) {
+            sectionStats.start(*audioProcessor);
+        }
+        if (sectionStats.isRunning() && !sectionStats.isReady()) {
+            char progressLabel[64];
+            snprintf(progressLabel, sizeof(progressLabel), "Section stats %.0f%%", sectionStats.getProgress() * 100.0f);
+            ImGui::ProgressBar(sectionStats.getProgress(), ImVec2(-1, 0), progressLabel);
+            return;
+        }
+        ImGui::BeginDisabled(!sectionStats.isReady() || markers.numSections() == 0);
+        if (ImGui::Button("Export section stats")) {
+            std::string csv = SectionStats::csvHeader();
+            for (const auto& stats : sectionStats.computeSections(markers.toVector())) {
+                SectionStats::appendCsvRow(csv, currentWavFile, stats);
+            }
+            std::string path = sectionStatsPath(currentWavFile);
+            if (writeFileAtomic(path, csv)) {
+                printf("Wrote section stats to %s\n", path.c_str());
+            } else {
+                printf("Cannot write %s\n", path.c_str());
+            }
+        }
+        ImGui::EndDisabled();
+    }
+
+    // Runs the onset detector and accepts or rejects its proposals in bulk,
+    // either all of them or the ones in the visible range
+    void renderSuggestions() {
+        ImGui::Separator();
+        std::vector<Marker> proposed;
+        if (onsetDetector.takeSuggestions(proposed)) {
+            // Samples that already carry a point marker are not proposed again
+            proposed.erase(std::remove_if(proposed.begin(), proposed.end(),
+                [&](const Marker& m) { return hasPointAt(m.sample); }), proposed.end());
+            printf("Onset detection proposed %zu markers\n", proposed.size());
+            suggestions.assign(std::move(proposed));
+        }
+
+        if (onsetDetector.isRunning()) {
+            char progressLabel[64];
+            snprintf(progressLabel, sizeof(progressLabel), "Detecting %.0f%%", onsetDetector.getProgress() * 100.0f);
+            ImGui::ProgressBar(onsetDetector.getProgress(), ImVec2(-1, 0), progressLabel);
+            if (ImGui::Button("Cancel")) onsetDetector.cancel();
+            return;
+        }
+        ImGui::BeginDisabled(!audioProcessor->isLoaded());
+        if (ImGui::Button("Suggest markers")) {
+            suggestions.clear();
+            onsetDetector.start(*audioProcessor);
+        }
+        ImGui::EndDisabled();
+        if (suggestions.empty()) return;
+
+        ImGui::SameLine();
+        ImGui::Text("%zu suggested", suggestions.numPoints());
+        std::vector<Marker> visible;
+        suggestions.forEachPointIn((size_t)std::max(plotXMin, 0.0), (size_t)std::max(plotXMax, 0.0),
+            [&](size_t, const Marker& m) { visible.push_back(m); });
+        if (ImGui::Button("Accept all")) {
+            acceptSuggestions(suggestions.toVector());
+            suggestions.clear();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reject all")) {
+            suggestions.clear();
+        }
+        ImGui::BeginDisabled(visible.empty());
+        if (ImGui::Button("Accept visible")) {
+            acceptSuggestions(visible);
+            suggestions.eraseAll(visible);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reject visible")) {
+            suggestions.eraseAll(visible);
+        }
+        ImGui::EndDisabled();
+    }
+
+    void acceptSuggestions(const std::vector<Marker>& accepted) {
+        std::vector<Marker> fresh;
+        for (const Marker& mark : accepted) {
+            // Accepted proposals are sorted, a repeated sample is skipped too
+            if (hasPointAt(mark.sample) || (!fresh.empty() && fresh.back().sample == mark.sample)) continue;
+            fresh.push_back(mark);
+        }
+        // One undo step for the whole batch
+        history.insertAll(fresh);
+        printf("Accepted %zu suggested markers\n", fresh.size());
+    }
+
+    bool hasPointAt(size_t sample) const {
+        size_t rank = markers.lowerBoundPoint(sample);
+        return rank < markers.numPoints() && markers.point(rank).sample == sample;
+    }
+
+    // Points play from their sample, sections from their start, looping
+    // over the section when loopSections is on
+    void playMarker(const Marker& mark) {
+        if (MarkerStore::isSection(mark) && loopSections) {
+            player.setLoop(mark.sample, mark.end + 1);
+        } else {
+            player.setLoop(0, 0);
+        }
+        player.seek(mark.sample);
+        player.play();
     }
 };
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <wav_file>\n", argv[0]);
+    // --tail follows a file that is still being recorded, --cache-mb bounds
+    // the audio kept for the files of a directory or playlist
+    bool tail = false;
+    size_t cacheBytes = Session::kDefaultBudgetBytes;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--tail") == 0) {
+            tail = true;
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cacheBytes = strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path || cacheBytes == 0) {
+        printf("Usage: %s [--tail] [--cache-mb MB] <wav_file|directory|playlist>\n", argv[0]);
         return 1;
     }
 
@@ -518,14 +1194,15 @@ int main(int argc, char* argv[]) {
     }
 
 
-    AudioVisualizer visualizer;
-    if (!visualizer.init(argv[1])) {
-        printf("Failed to initialize visualizer. Make sure the file is MONO\n");
+    AudioVisualizer visualizer(cacheBytes);
+    if (!visualizer.init(path, tail)) {
+        printf("Failed to initialize visualizer. Make sure the file is a PCM or float WAV\n");
         return 1;
     }
 
-    while (visualizer.handleEvents()) {
-        visualizer.render();
+    bool redraw = true;
+    while (visualizer.handleEvents(redraw)) {
+        if (redraw) visualizer.render();
     }
 
     visualizer.cleanup();
@@ -0,0 +1,77 @@
+#include "mapped_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+bool MappedFile::open(const std::string& filename, size_t reserveBytes) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // Pages past the end of the file become readable once it has grown there
+    size_t mapLength = std::max<size_t>(st.st_size, reserveBytes);
+    void* addr = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    // The mapping stays valid after the descriptor is closed
+    if (reserveBytes > 0) {
+        descriptor = fd;
+    } else {
+        ::close(fd);
+    }
+
+    base = static_cast<uint8_t*>(addr);
+    length = st.st_size;
+    reserved = mapLength;
+    return true;
+}
+
+void MappedFile::close() {
+    if (base != nullptr) {
+        munmap(base, reserved);
+        base = nullptr;
+        length = 0;
+        reserved = 0;
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+        descriptor = -1;
+    }
+}
+
+size_t MappedFile::refreshSize() {
+    struct stat st;
+    if (descriptor >= 0 && fstat(descriptor, &st) == 0) {
+        length = std::max(length, std::min<size_t>(st.st_size, reserved));
+    }
+    return length;
+}
+
+void MappedFile::adviseSequential() const {
+    if (base != nullptr) {
+        madvise(base, length, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::release(size_t offset, size_t count) const {
+    if (base == nullptr || offset >= length) return;
+
+    // madvise works on whole pages, only release the ones fully inside the range
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = std::min(offset + count, length) / pageSize * pageSize;
+    if (begin < end) {
+        madvise(base + begin, end - begin, MADV_DONTNEED);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. A file that is still being
+// written can be mapped with address space reserved past its end, the
+// mapping then never moves and refreshSize() exposes what was appended.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps max(file size, reserveBytes) bytes, only size() of them are readable
+    bool open(const std::string& filename, size_t reserveBytes = 0);
+    void close();
+    // Re-reads the size of a file opened with a reservation, capped at the
+    // reservation. Files are expected to only grow.
+    size_t refreshSize();
+
+    bool isOpen() const { return base != nullptr; }
+    const uint8_t* data() const { return base; }
+    size_t size() const { return length; }
+    size_t capacity() const { return reserved; }
+
+    // Hints that the file will be read front to back
+    void adviseSequential() const;
+    // Drops the pages of [offset, offset + count) from the resident set, they
+    // are read back from disk if touched again
+    void release(size_t offset, size_t count) const;
+
+private:
+    uint8_t* base = nullptr;
+    size_t length = 0;
+    size_t reserved = 0;
+    // Kept open for refreshSize() when space was reserved
+    int descriptor = -1;
+};
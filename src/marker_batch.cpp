@@ -0,0 +1,50 @@
+#include "marker_batch.h"
+#include <algorithm>
+
+void MarkerBatch::clear() {
+    for (int i = 0; i < kNumIntensities; ++i) {
+        lines[i].clear();
+        counts[i].clear();
+    }
+    spans.clear();
+    visiblePoints = 0;
+    visibleSections = 0;
+}
+
+void buildMarkerBatch(const MarkerStore& store, size_t from, size_t to,
+                      double samplesPerPixel, MarkerBatch& batch) {
+    batch.clear();
+    if (samplesPerPixel < 1.0) samplesPerPixel = 1.0;
+    const double pixelsPerSample = 1.0 / samplesPerPixel;
+
+    // Points come in sample order, so a column only has to be compared
+    // with the last line of its intensity
+    int64_t lastColumn[MarkerBatch::kNumIntensities];
+    for (int i = 0; i < MarkerBatch::kNumIntensities; ++i) lastColumn[i] = -1;
+    store.forEachPointIn(from, to, [&](size_t, const Marker& mark) {
+        int level = std::min(std::max(mark.intensity, 0), MarkerBatch::kNumIntensities - 1);
+        int64_t column = static_cast<int64_t>((mark.sample - from) * pixelsPerSample);
+        if (column == lastColumn[level]) {
+            ++batch.counts[level].back();
+        } else {
+            batch.lines[level].push_back(static_cast<double>(mark.sample));
+            batch.counts[level].push_back(1);
+            lastColumn[level] = column;
+        }
+        ++batch.visiblePoints;
+    });
+
+    // Sections are visited in start order, anything starting within a pixel
+    // of the current span joins it
+    store.forEachSectionIn(from, to, [&](size_t, const Marker& mark) {
+        double start = static_cast<double>(mark.sample);
+        double end = static_cast<double>(mark.end);
+        if (!batch.spans.empty() && start <= batch.spans.back() + samplesPerPixel) {
+            batch.spans.back() = std::max(batch.spans.back(), end);
+        } else {
+            batch.spans.push_back(start);
+            batch.spans.push_back(end);
+        }
+        ++batch.visibleSections;
+    });
+}
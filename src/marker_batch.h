@@ -0,0 +1,32 @@
+#pragma once
+#include "marker_store.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// The visible markers reduced to what can actually be told apart on screen.
+//
+// Points are grouped by intensity so each group is drawn as a single plot
+// item, and points falling into the same pixel column of the same group are
+// merged into one line that remembers how many markers it stands for.
+// Sections that touch at the current zoom are merged into one span.
+struct MarkerBatch {
+    static constexpr int kNumIntensities = 4;
+
+    // Line positions per intensity, at most one per pixel column
+    std::vector<double> lines[kNumIntensities];
+    // Number of markers behind each line
+    std::vector<uint32_t> counts[kNumIntensities];
+    // Merged sections as start, end pairs
+    std::vector<double> spans;
+
+    size_t visiblePoints = 0;
+    size_t visibleSections = 0;
+
+    void clear();
+};
+
+// Fills batch with the markers in [from, to] for a view samplesPerPixel wide
+// per pixel column. Intensities out of range are drawn as the nearest level.
+void buildMarkerBatch(const MarkerStore& store, size_t from, size_t to,
+                      double samplesPerPixel, MarkerBatch& batch);
@@ -0,0 +1,135 @@
+#include "marker_history.h"
+#include "profiler.h"
+#include <algorithm>
+#include <utility>
+
+static MarkerHistory::Record inverse(const MarkerHistory::Record& record) {
+    using Op = MarkerJournal::Op;
+    switch (record.op) {
+        case Op::Insert: return {Op::Delete, record.marker, {}};
+        case Op::Delete: return {Op::Insert, record.marker, {}};
+        case Op::Modify: break;
+    }
+    return {Op::Modify, record.replacement, record.marker};
+}
+
+void MarkerHistory::insert(const Marker& marker) {
+    markers.insert(marker);
+    std::vector<Record> records{{MarkerJournal::Op::Insert, marker, {}}};
+    journal.record(records);
+    push(std::move(records));
+}
+
+void MarkerHistory::eraseAll(std::vector<Marker> marks) {
+    // Only what was actually stored is journaled and undone
+    std::vector<Marker> erased = markers.eraseAll(std::move(marks));
+    if (erased.empty()) return;
+    std::vector<Record> records;
+    records.reserve(erased.size());
+    for (const Marker& mark : erased) records.push_back({MarkerJournal::Op::Delete, mark, {}});
+    journal.record(records);
+    push(std::move(records));
+}
+
+void MarkerHistory::insertAll(const std::vector<Marker>& marks) {
+    if (marks.empty()) return;
+    std::vector<Record> records;
+    records.reserve(marks.size());
+    for (const Marker& mark : marks) {
+        markers.insert(mark);
+        records.push_back({MarkerJournal::Op::Insert, mark, {}});
+    }
+    journal.record(records);
+    push(std::move(records));
+}
+
+void MarkerHistory::commitDrag(const Marker& before, const Marker& after) {
+    if (before == after) return;
+    Record record{MarkerJournal::Op::Modify, before, after};
+    journal.record({record});
+
+    // Regrabbing the section right away continues the same step
+    auto now = std::chrono::steady_clock::now();
+    if (!undoSteps.empty() && redoSteps.empty()) {
+        Step& last = undoSteps.back();
+        if (last.records.size() == 1 && last.records[0].op == MarkerJournal::Op::Modify &&
+                last.records[0].replacement == before && now - last.time < kCoalesceWindow) {
+            last.records[0].replacement = after;
+            last.time = now;
+            return;
+        }
+    }
+    push({record});
+}
+
+bool MarkerHistory::undo() {
+    if (undoSteps.empty()) return false;
+    PROFILE_SCOPE("undo");
+    Step step = std::move(undoSteps.back());
+    undoSteps.pop_back();
+    replay(step.records, true);
+    redoSteps.push_back(std::move(step));
+    return true;
+}
+
+bool MarkerHistory::redo() {
+    if (redoSteps.empty()) return false;
+    PROFILE_SCOPE("redo");
+    Step step = std::move(redoSteps.back());
+    redoSteps.pop_back();
+    replay(step.records, false);
+    undoSteps.push_back(std::move(step));
+    return true;
+}
+
+void MarkerHistory::clear() {
+    undoSteps.clear();
+    redoSteps.clear();
+    recordCount = 0;
+}
+
+void MarkerHistory::push(std::vector<Record> records) {
+    // A new edit ends the redo branch
+    for (const Step& step : redoSteps) recordCount -= step.records.size();
+    redoSteps.clear();
+    // A step that alone exceeds the bound can't be undone, and neither can
+    // anything before it
+    if (records.size() > kMaxRecords) {
+        clear();
+        return;
+    }
+    recordCount += records.size();
+    undoSteps.push_back({std::move(records), std::chrono::steady_clock::now()});
+    trim();
+}
+
+void MarkerHistory::replay(const std::vector<Record>& records, bool inverse) {
+    // Undone in reverse order, the journal sees what the store sees
+    std::vector<Record> applied;
+    applied.reserve(records.size());
+    if (inverse) {
+        for (auto it = records.rbegin(); it != records.rend(); ++it) applied.push_back(::inverse(*it));
+    } else {
+        applied = records;
+    }
+
+    // Batch deletes, e.g. redoing a list deletion, go through the store's batch erase
+    bool batchErase = applied.size() >= MarkerStore::kBatchEraseThreshold &&
+        std::all_of(applied.begin(), applied.end(), [](const Record& r) { return r.op == MarkerJournal::Op::Delete; });
+    if (batchErase) {
+        std::vector<Marker> erased;
+        erased.reserve(applied.size());
+        for (const Record& record : applied) erased.push_back(record.marker);
+        markers.eraseAll(std::move(erased));
+    } else {
+        for (const Record& record : applied) MarkerJournal::apply(markers, record);
+    }
+    journal.record(applied);
+}
+
+void MarkerHistory::trim() {
+    while (recordCount > kMaxRecords && !undoSteps.empty()) {
+        recordCount -= undoSteps.front().records.size();
+        undoSteps.pop_front();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "marker_journal.h"
+#include "marker_store.h"
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+
+// The one way markers are edited: every change is applied to the store,
+// queued in the journal and kept as an undoable step.
+//
+// A step holds the delta records of one user action (an insert, a batch
+// delete, a whole section drag) and is undone by applying their inverses,
+// which go to the journal like any other edit. Steps are dropped oldest
+// first to keep at most kMaxRecords records.
+class MarkerHistory {
+public:
+    using Record = MarkerJournal::Record;
+
+    static constexpr size_t kMaxRecords = size_t(1) << 16;
+    // A drag of the section the last step moved, started this soon after,
+    // extends that step
+    static constexpr std::chrono::milliseconds kCoalesceWindow{1000};
+
+    MarkerHistory(MarkerStore& markers, MarkerJournal& journal) : markers(markers), journal(journal) {}
+
+    void insert(const Marker& marker);
+    // Removes the stored markers among marks as one step, others are ignored
+    void eraseAll(std::vector<Marker> marks);
+    void insertAll(const std::vector<Marker>& marks);
+    // A drag moves the stored section every frame, this records the whole
+    // drag from before to after once it ends, without applying it again
+    void commitDrag(const Marker& before, const Marker& after);
+
+    bool canUndo() const { return !undoSteps.empty(); }
+    bool canRedo() const { return !redoSteps.empty(); }
+    bool undo();
+    bool redo();
+    // Forgets every step, the store is left as it is
+    void clear();
+    size_t getRecordCount() const { return recordCount; }
+
+private:
+    struct Step {
+        std::vector<Record> records;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    void push(std::vector<Record> records);
+    void replay(const std::vector<Record>& records, bool inverse);
+    void trim();
+
+    MarkerStore& markers;
+    MarkerJournal& journal;
+    std::deque<Step> undoSteps;
+    std::vector<Step> redoSteps;
+    size_t recordCount = 0;
+};
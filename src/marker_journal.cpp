@@ -0,0 +1,261 @@
+#include "marker_journal.h"
+#include "sidecar.h"
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <cinttypes>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* kJournalMagic = "#audiomarker-journal";
+
+static int formatMarker(char* out, size_t size, const Marker& m) {
+    return snprintf(out, size, "%zu,%d,%zu", m.sample, m.intensity, m.end);
+}
+
+static bool parseMarker(const char*& p, Marker& m) {
+    char* next;
+    m.sample = strtoull(p, &next, 10);
+    if (*next != ',') return false;
+    m.intensity = static_cast<int>(strtol(next + 1, &next, 10));
+    if (*next != ',') return false;
+    m.end = strtoull(next + 1, &next, 10);
+    p = next;
+    return true;
+}
+
+bool MarkerJournal::open(const std::string& path, MarkerStore& markers, const SidecarFile* cache) {
+    close();
+    csvPath = path;
+    journalPath = path + ".journal";
+
+    csvHash = 0;
+    std::vector<Marker> marks;
+    bool hasCsv;
+    if (cache && cache->matchesCsv(csvPath)) {
+        cache->readMarkers(marks);
+        csvHash = cache->getCsvHash();
+        hasCsv = true;
+    } else {
+        hasCsv = loadMarkersCsv(csvPath, marks, &csvHash);
+    }
+    markers.assign(std::move(marks));
+    size_t replayed = replay(csvHash, markers);
+    if (replayed > 0) {
+        printf("Recovered %zu marker edits from %s\n", replayed, journalPath.c_str());
+    }
+
+    mirror = markers;
+    uncompacted = replayed;
+    lastCompaction = std::chrono::steady_clock::now();
+    stopping = false;
+    compactRequested = replayed > 0;
+
+    // Recovered edits are folded into the CSV right away by the writer,
+    // otherwise the journal is restarted against the CSV as it is
+    if (replayed == 0 && !startJournal(csvHash)) {
+        printf("Failed to start marker journal: %s\n", journalPath.c_str());
+    } else if (replayed > 0) {
+        journalFd = ::open(journalPath.c_str(), O_WRONLY | O_APPEND);
+    }
+
+    writer = std::thread([this] {
+        profilerSetThreadName("journal writer");
+        writerLoop();
+    });
+    return hasCsv || replayed > 0;
+}
+
+void MarkerJournal::close() {
+    if (!writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if (journalFd >= 0) {
+        ::close(journalFd);
+        journalFd = -1;
+    }
+}
+
+void MarkerJournal::recordInsert(const Marker& marker) {
+    push({Op::Insert, marker, {}});
+}
+
+void MarkerJournal::recordDelete(const Marker& marker) {
+    push({Op::Delete, marker, {}});
+}
+
+void MarkerJournal::recordModify(const Marker& before, const Marker& after) {
+    push({Op::Modify, before, after});
+}
+
+void MarkerJournal::requestCompaction() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compactRequested = true;
+    }
+    wake.notify_one();
+}
+
+void MarkerJournal::push(const Record& record) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(record);
+    }
+    wake.notify_one();
+}
+
+void MarkerJournal::record(const std::vector<Record>& records) {
+    if (records.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.insert(pending.end(), records.begin(), records.end());
+    }
+    wake.notify_one();
+}
+
+void MarkerJournal::apply(MarkerStore& markers, const Record& record) {
+    switch (record.op) {
+        case Op::Insert: markers.insert(record.marker); break;
+        case Op::Delete: markers.erase(record.marker); break;
+        case Op::Modify:
+            markers.erase(record.marker);
+            markers.insert(record.replacement);
+            break;
+    }
+}
+
+void MarkerJournal::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait_for(lock, std::chrono::seconds(1), [this] {
+            return stopping || compactRequested || !pending.empty();
+        });
+        if (!pending.empty() && !stopping) {
+            // Let a burst of edits settle so it lands in one write
+            wake.wait_for(lock, kDebounce, [this] { return stopping; });
+        }
+
+        std::vector<Record> batch;
+        batch.swap(pending);
+        bool compactNow = compactRequested || stopping;
+        compactRequested = false;
+        bool done = stopping;
+        lock.unlock();
+
+        if (!batch.empty()) {
+            writeBatch(batch);
+        }
+        bool overdue = uncompacted > 0 &&
+            std::chrono::steady_clock::now() - lastCompaction >= kCompactInterval;
+        if (uncompacted > 0 && (compactNow || overdue || uncompacted >= kCompactRecords)) {
+            compact();
+        }
+
+        lock.lock();
+        if (done && pending.empty()) break;
+    }
+}
+
+void MarkerJournal::writeBatch(const std::vector<Record>& batch) {
+    PROFILE_SCOPE("journal append");
+    std::string out;
+    char line[160];
+    for (const auto& record : batch) {
+        int len = snprintf(line, sizeof(line), "%c,", static_cast<char>(record.op));
+        len += formatMarker(line + len, sizeof(line) - len, record.marker);
+        if (record.op == Op::Modify) {
+            line[len++] = ',';
+            len += formatMarker(line + len, sizeof(line) - len, record.replacement);
+        }
+        line[len++] = '\n';
+        out.append(line, len);
+        apply(mirror, record);
+    }
+    uncompacted += batch.size();
+
+    // Records only count once they are on disk, a torn last line is ignored on replay
+    if (journalFd >= 0) {
+        size_t written = 0;
+        while (written < out.size()) {
+            ssize_t n = write(journalFd, out.data() + written, out.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        if (written != out.size() || fdatasync(journalFd) != 0) {
+            printf("Failed to append to marker journal: %s\n", journalPath.c_str());
+        }
+    }
+}
+
+bool MarkerJournal::compact() {
+    PROFILE_SCOPE("journal compact");
+    uint64_t newHash = 0;
+    if (!saveMarkersCsv(csvPath, mirror.toVector(), &newHash)) {
+        printf("Failed to compact markers into %s\n", csvPath.c_str());
+        return false;
+    }
+    csvHash = newHash;
+    // The old journal now names a CSV that no longer exists, so even if we
+    // crash before the next line it will not be replayed
+    if (!startJournal(csvHash)) {
+        printf("Failed to restart marker journal: %s\n", journalPath.c_str());
+    }
+    printf("Saved %zu markers to CSV: %s\n", mirror.size(), csvPath.c_str());
+    uncompacted = 0;
+    lastCompaction = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool MarkerJournal::startJournal(uint64_t csvHash) {
+    if (journalFd >= 0) {
+        ::close(journalFd);
+        journalFd = -1;
+    }
+
+    char header[64];
+    snprintf(header, sizeof(header), "%s %016" PRIx64 "\n", kJournalMagic, csvHash);
+    if (!writeFileAtomic(journalPath, header)) return false;
+    journalFd = ::open(journalPath.c_str(), O_WRONLY | O_APPEND);
+    return journalFd >= 0;
+}
+
+size_t MarkerJournal::replay(uint64_t csvHash, MarkerStore& markers) const {
+    std::ifstream journal(journalPath);
+    if (!journal.is_open()) return 0;
+
+    std::string line;
+    char expected[64];
+    snprintf(expected, sizeof(expected), "%s %016" PRIx64, kJournalMagic, csvHash);
+    if (!std::getline(journal, line) || line != expected) {
+        // Written against another version of the CSV, already compacted
+        return 0;
+    }
+
+    size_t replayed = 0;
+    while (std::getline(journal, line)) {
+        // A line cut short by a crash has no newline and is dropped
+        if (journal.eof()) break;
+
+        Record record{};
+        const char* p = line.c_str();
+        if (line.size() < 2 || line[1] != ',') continue;
+        record.op = static_cast<Op>(line[0]);
+        p += 2;
+        bool ok = parseMarker(p, record.marker);
+        if (ok && record.op == Op::Modify) {
+            ok = *p == ',' && parseMarker(++p, record.replacement);
+        }
+        if (!ok || (record.op != Op::Insert && record.op != Op::Delete && record.op != Op::Modify)) {
+            printf("Error parsing journal line: %s\n", line.c_str());
+            continue;
+        }
+        apply(markers, record);
+        replayed++;
+    }
+    return replayed;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "markers.h"
+#include "marker_store.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+class SidecarFile;
+
+// Append-only log of marker edits, written by a background thread and folded
+// into the CSV now and then. The UI thread only queues records, it never
+// touches the disk. The journal names the CSV it applies to by hash, so a
+// crash between compaction steps can never replay edits twice.
+class MarkerJournal {
+public:
+    enum class Op : char {
+        Insert = '+',
+        Delete = '-',
+        Modify = '~'
+    };
+
+    struct Record {
+        Op op;
+        Marker marker;      // inserted, deleted, or the one being modified
+        Marker replacement; // new value for Modify
+    };
+
+    // Bursts of edits closer than this end up in a single write
+    static constexpr std::chrono::milliseconds kDebounce{200};
+    // Compaction triggers, whichever comes first
+    static constexpr size_t kCompactRecords = 10000;
+    static constexpr std::chrono::seconds kCompactInterval{30};
+
+    MarkerJournal() = default;
+    ~MarkerJournal() { close(); }
+    MarkerJournal(const MarkerJournal&) = delete;
+    MarkerJournal& operator=(const MarkerJournal&) = delete;
+
+    // Loads the CSV, replays any journal left next to it by an earlier run
+    // and starts the writer. Returns false when there was no CSV. The
+    // markers come from cache instead when it was written for this CSV.
+    bool open(const std::string& csvPath, MarkerStore& markers, const SidecarFile* cache = nullptr);
+    // Writes pending records, compacts and stops the writer
+    void close();
+
+    void recordInsert(const Marker& marker);
+    void recordDelete(const Marker& marker);
+    void recordModify(const Marker& before, const Marker& after);
+    // Queues a batch of records with a single wake-up of the writer
+    void record(const std::vector<Record>& records);
+    void requestCompaction();
+
+    const std::string& getCsvPath() const { return csvPath; }
+    // After close(): whether the CSV on disk holds every edit, and its hash
+    bool isCsvCurrent() const { return uncompacted == 0; }
+    uint64_t getCsvHash() const { return csvHash; }
+
+    static void apply(MarkerStore& markers, const Record& record);
+
+private:
+    void push(const Record& record);
+    void writerLoop();
+    void writeBatch(const std::vector<Record>& batch);
+    bool compact();
+    bool startJournal(uint64_t csvHash);
+    size_t replay(uint64_t csvHash, MarkerStore& markers) const;
+
+    std::string csvPath;
+    std::string journalPath;
+    int journalFd = -1;
+    uint64_t csvHash = 0;
+
+    // Writer-side copy of the markers, what compaction writes out
+    MarkerStore mirror;
+    size_t uncompacted = 0;
+    std::chrono::steady_clock::time_point lastCompaction;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Record> pending;
+    bool compactRequested = false;
+    bool stopping = false;
+};
@@ -0,0 +1,409 @@
+#include "marker_store.h"
+#include <algorithm>
+
+void MarkerStore::clear() {
+    chunks.assign(1, {});
+    chunkOffsets.assign(1, 0);
+    pointCount = 0;
+    sectionChunks.assign(1, {});
+    sectionOffsets.assign(1, 0);
+    sectionCount = 0;
+    rebuildSectionTree();
+    version++;
+}
+
+void MarkerStore::assign(std::vector<Marker> marks) {
+    clear();
+    // CSV and sidecar content is usually sorted already
+    auto bySample = [](const Marker& a, const Marker& b) { return a.sample < b.sample; };
+    if (!std::is_sorted(marks.begin(), marks.end(), bySample)) {
+        std::stable_sort(marks.begin(), marks.end(), bySample);
+    }
+
+    std::vector<Marker> points, sections;
+    std::vector<int> ids;
+    points.reserve(marks.size());
+    for (const auto& marker : marks) {
+        if (isSection(marker)) {
+            sections.push_back(marker);
+            ids.push_back(nextSectionId++);
+        } else {
+            points.push_back(marker);
+        }
+    }
+    rebuildChunks(points);
+    rebuildSectionChunks(sections, ids);
+}
+
+void MarkerStore::rebuildSectionChunks(const std::vector<Marker>& marks, const std::vector<int>& ids) {
+    // Half full like the point chunks
+    sectionChunks.clear();
+    for (size_t i = 0; i < marks.size(); ++i) {
+        if (sectionChunks.empty() || sectionChunks.back().marks.size() >= kSectionChunkSize / 2) {
+            sectionChunks.emplace_back();
+        }
+        auto& chunk = sectionChunks.back();
+        chunk.marks.push_back(marks[i]);
+        chunk.ids.push_back(ids[i]);
+        chunk.maxEnd = std::max(chunk.maxEnd, marks[i].end);
+    }
+    if (sectionChunks.empty()) sectionChunks.emplace_back();
+    sectionCount = marks.size();
+    updateSectionOffsets(0);
+    rebuildSectionTree();
+}
+
+void MarkerStore::rebuildChunks(const std::vector<Marker>& points) {
+    // Chunks start half full so the first inserts do not split them right away
+    chunks.clear();
+    for (const auto& marker : points) {
+        if (chunks.empty() || chunks.back().size() >= kChunkSize / 2) {
+            chunks.emplace_back();
+            chunks.back().reserve(kChunkSize);
+        }
+        chunks.back().push_back(marker);
+    }
+    if (chunks.empty()) chunks.emplace_back();
+    pointCount = points.size();
+    updateChunkOffsets(0);
+}
+
+std::vector<Marker> MarkerStore::toVector() const {
+    std::vector<Marker> out;
+    out.reserve(size());
+    for (const auto& chunk : chunks) {
+        out.insert(out.end(), chunk.begin(), chunk.end());
+    }
+    std::vector<Marker> sections;
+    sections.reserve(sectionCount);
+    for (const auto& chunk : sectionChunks) {
+        sections.insert(sections.end(), chunk.marks.begin(), chunk.marks.end());
+    }
+    std::vector<Marker> merged(out.size() + sections.size());
+    std::merge(out.begin(), out.end(), sections.begin(), sections.end(), merged.begin(),
+        [](const Marker& a, const Marker& b) { return a.sample < b.sample; });
+    return merged;
+}
+
+void MarkerStore::insert(const Marker& marker) {
+    if (isSection(marker)) {
+        insertSection(marker, nextSectionId++);
+    } else {
+        insertPoint(marker);
+    }
+    version++;
+}
+
+bool MarkerStore::erase(const Marker& marker) {
+    bool erased = false;
+    if (isSection(marker)) {
+        // First chunk whose last section starts at or after the marker
+        size_t c = std::partition_point(sectionChunks.begin(), sectionChunks.end() - 1,
+            [&](const SectionChunk& chunk) { return chunk.marks.back().sample < marker.sample; }) - sectionChunks.begin();
+        for (; !erased && c < sectionChunks.size(); ++c) {
+            const auto& marks = sectionChunks[c].marks;
+            auto it = std::lower_bound(marks.begin(), marks.end(), marker.sample,
+                [](const Marker& m, size_t s) { return m.sample < s; });
+            for (; it != marks.end() && it->sample == marker.sample; ++it) {
+                if (*it == marker) {
+                    eraseSection(c, it - marks.begin());
+                    erased = true;
+                    break;
+                }
+            }
+            // Equal starts can continue into the next chunk
+            if (it != marks.end()) break;
+        }
+    } else {
+        erased = erasePoint(marker);
+    }
+    if (erased) version++;
+    return erased;
+}
+
+std::vector<Marker> MarkerStore::eraseAll(std::vector<Marker> marks) {
+    MarkerLess less;
+    std::sort(marks.begin(), marks.end(), less);
+
+    // Each listed marker removes at most one stored marker
+    std::vector<char> used(marks.size(), 0);
+    auto take = [&](const Marker& stored) {
+        auto range = std::equal_range(marks.begin(), marks.end(), stored, less);
+        for (auto it = range.first; it != range.second; ++it) {
+            size_t i = it - marks.begin();
+            if (!used[i]) {
+                used[i] = 1;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t erased = 0;
+    size_t numSectionMarks = std::count_if(marks.begin(), marks.end(), isSection);
+    if (numSectionMarks > 0) {
+        // Rebuilt once, the ids stay with their sections
+        std::vector<Marker> sections;
+        std::vector<int> ids;
+        for (const auto& chunk : sectionChunks) {
+            for (size_t i = 0; i < chunk.marks.size(); ++i) {
+                if (take(chunk.marks[i])) continue;
+                sections.push_back(chunk.marks[i]);
+                ids.push_back(chunk.ids[i]);
+            }
+        }
+        erased += sectionCount - sections.size();
+        rebuildSectionChunks(sections, ids);
+    }
+
+    size_t numPointMarks = marks.size() - numSectionMarks;
+    if (numPointMarks > 0 && numPointMarks < kBatchEraseThreshold) {
+        for (size_t i = 0; i < marks.size(); ++i) {
+            if (!isSection(marks[i]) && erasePoint(marks[i])) {
+                used[i] = 1;
+                erased++;
+            }
+        }
+    } else if (numPointMarks > 0) {
+        // Large batches rebuild the chunks once instead of shifting them per point
+        std::vector<Marker> points;
+        points.reserve(pointCount);
+        for (const auto& chunk : chunks) {
+            for (const auto& marker : chunk) {
+                if (!take(marker)) points.push_back(marker);
+            }
+        }
+        erased += pointCount - points.size();
+        rebuildChunks(points);
+    }
+
+    std::vector<Marker> removed;
+    removed.reserve(erased);
+    for (size_t i = 0; i < marks.size(); ++i) {
+        if (used[i]) removed.push_back(marks[i]);
+    }
+    if (erased > 0) version++;
+    return removed;
+}
+
+const Marker& MarkerStore::point(size_t index) const {
+    size_t c = std::upper_bound(chunkOffsets.begin(), chunkOffsets.end(), index) - chunkOffsets.begin() - 1;
+    // Skip empty chunks sharing the same offset
+    while (index - chunkOffsets[c] >= chunks[c].size()) c++;
+    return chunks[c][index - chunkOffsets[c]];
+}
+
+size_t MarkerStore::lowerBoundPoint(size_t sample) const {
+    size_t c = chunkFor(sample);
+    const auto& chunk = chunks[c];
+    auto it = std::lower_bound(chunk.begin(), chunk.end(), sample,
+        [](const Marker& m, size_t s) { return m.sample < s; });
+    return chunkOffsets[c] + (it - chunk.begin());
+}
+
+size_t MarkerStore::chunkFor(size_t sample) const {
+    // First chunk whose last point is at or after sample, or the last chunk
+    size_t lo = 0, hi = chunks.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (chunks[mid].empty() || chunks[mid].back().sample < sample) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+void MarkerStore::insertPoint(const Marker& marker) {
+    size_t c = chunkFor(marker.sample);
+    auto& chunk = chunks[c];
+    auto pos = std::lower_bound(chunk.begin(), chunk.end(), marker.sample,
+        [](const Marker& m, size_t s) { return m.sample < s; });
+    chunk.insert(pos, marker);
+    pointCount++;
+
+    // Split full chunks in half
+    if (chunk.size() >= kChunkSize * 2) {
+        std::vector<Marker> upper(chunk.begin() + kChunkSize, chunk.end());
+        upper.reserve(kChunkSize * 2);
+        chunk.resize(kChunkSize);
+        chunks.insert(chunks.begin() + c + 1, std::move(upper));
+        chunkOffsets.insert(chunkOffsets.begin() + c + 1, 0);
+    }
+    updateChunkOffsets(c);
+}
+
+bool MarkerStore::erasePoint(const Marker& marker) {
+    for (size_t c = chunkFor(marker.sample); c < chunks.size(); ++c) {
+        auto& chunk = chunks[c];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), marker.sample,
+            [](const Marker& m, size_t s) { return m.sample < s; });
+        for (; it != chunk.end() && it->sample == marker.sample; ++it) {
+            if (*it == marker) {
+                chunk.erase(it);
+                pointCount--;
+                if (chunk.empty() && chunks.size() > 1) {
+                    chunks.erase(chunks.begin() + c);
+                    chunkOffsets.erase(chunkOffsets.begin() + c);
+                }
+                updateChunkOffsets(c == 0 ? 0 : c - 1);
+                return true;
+            }
+        }
+        // Equal samples can continue into the next chunk
+        if (it != chunk.end()) break;
+    }
+    return false;
+}
+
+void MarkerStore::updateChunkOffsets(size_t fromChunk) {
+    chunkOffsets.resize(chunks.size());
+    size_t offset = fromChunk == 0 ? 0 : chunkOffsets[fromChunk - 1] + chunks[fromChunk - 1].size();
+    for (size_t c = fromChunk; c < chunks.size(); ++c) {
+        chunkOffsets[c] = offset;
+        offset += chunks[c].size();
+    }
+}
+
+const Marker& MarkerStore::section(size_t index) const {
+    size_t c = sectionChunkAt(index);
+    return sectionChunks[c].marks[index];
+}
+
+int MarkerStore::sectionId(size_t index) const {
+    size_t c = sectionChunkAt(index);
+    return sectionChunks[c].ids[index];
+}
+
+size_t MarkerStore::sectionChunkAt(size_t& index) const {
+    size_t c = std::upper_bound(sectionOffsets.begin(), sectionOffsets.end(), index) - sectionOffsets.begin() - 1;
+    while (index - sectionOffsets[c] >= sectionChunks[c].marks.size()) c++;
+    index -= sectionOffsets[c];
+    return c;
+}
+
+size_t MarkerStore::insertSection(const Marker& marker, int id) {
+    // First chunk whose last section starts after the marker, equal starts
+    // keep their order
+    size_t c = std::partition_point(sectionChunks.begin(), sectionChunks.end() - 1,
+        [&](const SectionChunk& chunk) { return chunk.marks.back().sample <= marker.sample; }) - sectionChunks.begin();
+    auto& chunk = sectionChunks[c];
+    auto pos = std::upper_bound(chunk.marks.begin(), chunk.marks.end(), marker.sample,
+        [](size_t sample, const Marker& m) { return sample < m.sample; });
+    size_t i = pos - chunk.marks.begin();
+    chunk.marks.insert(pos, marker);
+    chunk.ids.insert(chunk.ids.begin() + i, id);
+    chunk.maxEnd = std::max(chunk.maxEnd, marker.end);
+    sectionCount++;
+    size_t index = sectionOffsets[c] + i;
+
+    if (chunk.marks.size() >= kSectionChunkSize * 2) {
+        // Split in half, the chunk count changes so the tree is rebuilt, once
+        // per kSectionChunkSize inserts at most
+        SectionChunk upper;
+        upper.marks.assign(chunk.marks.begin() + kSectionChunkSize, chunk.marks.end());
+        upper.ids.assign(chunk.ids.begin() + kSectionChunkSize, chunk.ids.end());
+        chunk.marks.resize(kSectionChunkSize);
+        chunk.ids.resize(kSectionChunkSize);
+        chunk.maxEnd = 0;
+        for (const auto& m : chunk.marks) chunk.maxEnd = std::max(chunk.maxEnd, m.end);
+        for (const auto& m : upper.marks) upper.maxEnd = std::max(upper.maxEnd, m.end);
+        sectionChunks.insert(sectionChunks.begin() + c + 1, std::move(upper));
+        updateSectionOffsets(c);
+        rebuildSectionTree();
+    } else {
+        updateSectionOffsets(c);
+        updateSectionTree(c);
+    }
+    return index;
+}
+
+void MarkerStore::eraseSection(size_t c, size_t i) {
+    auto& chunk = sectionChunks[c];
+    chunk.marks.erase(chunk.marks.begin() + i);
+    chunk.ids.erase(chunk.ids.begin() + i);
+    sectionCount--;
+    if (chunk.marks.empty() && sectionChunks.size() > 1) {
+        sectionChunks.erase(sectionChunks.begin() + c);
+        updateSectionOffsets(c == 0 ? 0 : c - 1);
+        rebuildSectionTree();
+        return;
+    }
+    chunk.maxEnd = 0;
+    for (const auto& m : chunk.marks) chunk.maxEnd = std::max(chunk.maxEnd, m.end);
+    updateSectionOffsets(c);
+    updateSectionTree(c);
+}
+
+void MarkerStore::updateSectionOffsets(size_t fromChunk) {
+    sectionOffsets.resize(sectionChunks.size());
+    size_t offset = fromChunk == 0 ? 0 : sectionOffsets[fromChunk - 1] + sectionChunks[fromChunk - 1].marks.size();
+    for (size_t c = fromChunk; c < sectionChunks.size(); ++c) {
+        sectionOffsets[c] = offset;
+        offset += sectionChunks[c].marks.size();
+    }
+}
+
+size_t MarkerStore::modifySection(size_t index, size_t start, size_t end) {
+    size_t i = index;
+    size_t c = sectionChunkAt(i);
+    auto& chunk = sectionChunks[c];
+    version++;
+
+    // Neighbours by rank can sit in the chunks around this one
+    const Marker* prev = i > 0 ? &chunk.marks[i - 1] : c > 0 ? &sectionChunks[c - 1].marks.back() : nullptr;
+    const Marker* next = i + 1 < chunk.marks.size() ? &chunk.marks[i + 1] :
+        c + 1 < sectionChunks.size() ? &sectionChunks[c + 1].marks.front() : nullptr;
+    bool ordered = (!prev || prev->sample <= start) && (!next || start <= next->sample);
+    if (ordered) {
+        chunk.marks[i].sample = start;
+        chunk.marks[i].end = end;
+        chunk.maxEnd = 0;
+        for (const auto& m : chunk.marks) chunk.maxEnd = std::max(chunk.maxEnd, m.end);
+        updateSectionTree(c);
+        return index;
+    }
+
+    // Slide it to its new place, ids travel with it
+    Marker moved = chunk.marks[i];
+    moved.sample = start;
+    moved.end = end;
+    int id = chunk.ids[i];
+    eraseSection(c, i);
+    return insertSection(moved, id);
+}
+
+void MarkerStore::rebuildSectionTree() {
+    maxEnd.assign(sectionChunks.size() * 4 + 4, 0);
+    // Recursion depth is only log2(n)
+    struct Builder {
+        const std::vector<SectionChunk>& chunks;
+        std::vector<size_t>& tree;
+        size_t build(size_t node, size_t lo, size_t hi) {
+            if (hi - lo == 1) return tree[node] = chunks[lo].maxEnd;
+            size_t mid = (lo + hi) / 2;
+            return tree[node] = std::max(build(node * 2, lo, mid), build(node * 2 + 1, mid, hi));
+        }
+    };
+    Builder{sectionChunks, maxEnd}.build(1, 0, sectionChunks.size());
+}
+
+void MarkerStore::updateSectionTree(size_t chunk) {
+    // Walk down to the leaf recording the path, then fix the maxima on the way up
+    size_t path[64];
+    size_t depth = 0;
+    size_t node = 1, lo = 0, hi = sectionChunks.size();
+    while (hi - lo > 1) {
+        path[depth++] = node;
+        size_t mid = (lo + hi) / 2;
+        if (chunk < mid) {
+            node = node * 2;
+            hi = mid;
+        } else {
+            node = node * 2 + 1;
+            lo = mid;
+        }
+    }
+    maxEnd[node] = sectionChunks[chunk].maxEnd;
+    while (depth > 0) {
+        node = path[--depth];
+        maxEnd[node] = std::max(maxEnd[node * 2], maxEnd[node * 2 + 1]);
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include "markers.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Markers split into point markers and sections, both kept sorted.
+//
+// Points live in a list of small sorted chunks, so an insert or delete only
+// shifts one chunk instead of the whole set, and the chunk offsets still give
+// rank (index) access in O(log n).
+//
+// Sections are sorted by start in smaller chunks of their own, with a max-end
+// segment tree over the chunks, so an edit only shifts one chunk and walks
+// one path of the tree, and the sections overlapping a range are found
+// without scanning the other chunks.
+class MarkerStore {
+public:
+    static constexpr size_t kChunkSize = 512;
+    // Smaller, a visited section chunk is scanned whole
+    static constexpr size_t kSectionChunkSize = 64;
+    // Point batches at least this large are erased by rebuilding the chunks
+    static constexpr size_t kBatchEraseThreshold = 64;
+
+    MarkerStore() { clear(); }
+
+    void clear();
+    // Replaces the content, marks may be in any order
+    void assign(std::vector<Marker> marks);
+    // Every marker sorted by sample, the CSV order
+    std::vector<Marker> toVector() const;
+
+    static bool isSection(const Marker& m) { return m.end != 0; }
+
+    void insert(const Marker& marker);
+    // Removes one marker equal to marker, returns false if there is none
+    bool erase(const Marker& marker);
+    // Removes one stored marker per entry of marks, returns the ones found,
+    // sorted by MarkerLess
+    std::vector<Marker> eraseAll(std::vector<Marker> marks);
+
+    size_t size() const { return numPoints() + numSections(); }
+    bool empty() const { return size() == 0; }
+    size_t numPoints() const { return pointCount; }
+    size_t numSections() const { return sectionCount; }
+
+    // Points by rank in sample order
+    const Marker& point(size_t index) const;
+    // Rank of the first point at or after sample
+    size_t lowerBoundPoint(size_t sample) const;
+
+    // Sections by rank in start order, ids stay the same while a section is
+    // dragged around and reordered
+    const Marker& section(size_t index) const;
+    int sectionId(size_t index) const;
+    // Moves a section to [start, end], returns its new rank
+    size_t modifySection(size_t index, size_t start, size_t end);
+
+    // fn(rank, marker) for every point with from <= sample <= to, in order
+    template <typename Fn>
+    void forEachPointIn(size_t from, size_t to, Fn&& fn) const;
+    // fn(rank, section) for every section overlapping [from, to]
+    template <typename Fn>
+    void forEachSectionIn(size_t from, size_t to, Fn&& fn) const;
+
+    // Bumped on every change, lets views cache derived data
+    uint64_t getVersion() const { return version; }
+
+private:
+    void insertPoint(const Marker& marker);
+    bool erasePoint(const Marker& marker);
+    void rebuildChunks(const std::vector<Marker>& points);
+    size_t chunkFor(size_t sample) const;
+    void updateChunkOffsets(size_t fromChunk);
+
+    // Chunk holding the section of rank index, index becomes its position there
+    size_t sectionChunkAt(size_t& index) const;
+    size_t insertSection(const Marker& marker, int id);
+    void eraseSection(size_t c, size_t i);
+    void rebuildSectionChunks(const std::vector<Marker>& marks, const std::vector<int>& ids);
+    void updateSectionOffsets(size_t fromChunk);
+    void rebuildSectionTree();
+    void updateSectionTree(size_t chunk);
+    template <typename Fn>
+    void visitSections(size_t node, size_t lo, size_t hi, size_t last, size_t from, size_t to, Fn& fn) const;
+
+    std::vector<std::vector<Marker>> chunks;
+    std::vector<size_t> chunkOffsets; // rank of each chunk's first point
+    size_t pointCount = 0;
+
+    struct SectionChunk {
+        std::vector<Marker> marks;
+        std::vector<int> ids;
+        size_t maxEnd = 0;
+    };
+    std::vector<SectionChunk> sectionChunks;
+    std::vector<size_t> sectionOffsets; // rank of each chunk's first section
+    size_t sectionCount = 0;
+    std::vector<size_t> maxEnd; // segment tree over the section chunks, root at 1
+    int nextSectionId = 0;
+
+    uint64_t version = 0;
+};
+
+template <typename Fn>
+void MarkerStore::forEachPointIn(size_t from, size_t to, Fn&& fn) const {
+    size_t rank = lowerBoundPoint(from);
+    if (rank >= pointCount) return;
+
+    // Walk the chunks directly instead of paying a lookup per point
+    size_t c = chunkFor(from);
+    size_t i = rank - chunkOffsets[c];
+    for (; c < chunks.size(); ++c, i = 0) {
+        for (; i < chunks[c].size(); ++i, ++rank) {
+            if (chunks[c][i].sample > to) return;
+            fn(rank, chunks[c][i]);
+        }
+    }
+}
+
+template <typename Fn>
+void MarkerStore::forEachSectionIn(size_t from, size_t to, Fn&& fn) const {
+    if (sectionCount == 0) return;
+    // Only chunks starting at or before `to` can overlap
+    size_t last = 0;
+    size_t lo = 0, hi = sectionChunks.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (sectionChunks[mid].marks.front().sample <= to) lo = mid + 1; else hi = mid;
+    }
+    last = lo;
+    if (last == 0) return;
+    visitSections(1, 0, sectionChunks.size(), last, from, to, fn);
+}
+
+template <typename Fn>
+void MarkerStore::visitSections(size_t node, size_t lo, size_t hi, size_t last, size_t from, size_t to, Fn& fn) const {
+    // Skip subtrees that start too late or end too early
+    if (lo >= last || maxEnd[node] < from) return;
+    if (hi - lo == 1) {
+        const auto& chunk = sectionChunks[lo];
+        for (size_t i = 0; i < chunk.marks.size() && chunk.marks[i].sample <= to; ++i) {
+            if (chunk.marks[i].end >= from) fn(sectionOffsets[lo] + i, chunk.marks[i]);
+        }
+        return;
+    }
+    size_t mid = (lo + hi) / 2;
+    visitSections(node * 2, lo, mid, last, from, to, fn);
+    visitSections(node * 2 + 1, mid, hi, last, from, to, fn);
+}
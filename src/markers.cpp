@@ -0,0 +1,120 @@
+#include "markers.h"
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::string markerCsvPath(const std::string& wavFile) {
+    // Construct CSV filename (same base name as WAV file)
+    std::string csvFilename = wavFile;
+    size_t dotPos = csvFilename.find_last_of('.');
+    if (dotPos != std::string::npos) {
+        csvFilename = csvFilename.substr(0, dotPos);
+    }
+    return csvFilename + ".csv";
+}
+
+uint64_t hashBytes(const char* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool loadMarkersCsv(const std::string& csvPath, std::vector<Marker>& marks, uint64_t* contentHash) {
+    PROFILE_SCOPE("load markers csv");
+    if (contentHash) *contentHash = 0;
+    std::ifstream csvFile(csvPath, std::ios::binary);
+    if (!csvFile.is_open()) return false;
+
+    std::string content((std::istreambuf_iterator<char>(csvFile)), std::istreambuf_iterator<char>());
+    if (contentHash) *contentHash = hashBytes(content.data(), content.size());
+
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream ss(line);
+        std::string sampleStr, intensityStr, endStr;
+
+        // Parse sample number and intensity
+        if (std::getline(ss, sampleStr, ',') &&
+            std::getline(ss, intensityStr, ',')) {
+            try {
+                size_t sample = std::stoull(sampleStr);
+                int intensity = std::stoi(intensityStr);
+                if (intensity == -1 && std::getline(ss, endStr)) {
+                    size_t end = std::stoull(endStr);
+                    marks.push_back({sample, intensity, end});
+                } else {
+                    marks.push_back({sample, intensity, 0});
+                }
+            } catch (const std::exception& e) {
+                printf("Error parsing CSV line: %s\n", line.c_str());
+            }
+        }
+    }
+
+    // Sort markers after loading
+    std::stable_sort(marks.begin(), marks.end(),
+        [](const Marker& a, const Marker& b) {
+            return a.sample < b.sample;
+        });
+    return true;
+}
+
+bool saveMarkersCsv(const std::string& csvPath, const std::vector<Marker>& marks, uint64_t* contentHash) {
+    PROFILE_SCOPE("save markers csv");
+    std::string content;
+    content.reserve(marks.size() * 16);
+    char line[96];
+    for (const auto& marker : marks) {
+        int len;
+        if (marker.end == 0) {
+            len = snprintf(line, sizeof(line), "%zu,%d\n", marker.sample, marker.intensity);
+        } else {
+            len = snprintf(line, sizeof(line), "%zu,%d,%zu\n", marker.sample, marker.intensity, marker.end);
+        }
+        content.append(line, len);
+    }
+
+    if (contentHash) *contentHash = hashBytes(content.data(), content.size());
+    return writeFileAtomic(csvPath, content);
+}
+
+bool writeFileAtomic(const std::string& path, const std::string& data) {
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to open for writing: %s\n", tmpPath.c_str());
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    bool ok = written == data.size() && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        printf("Failed to write %s\n", path.c_str());
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
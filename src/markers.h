@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct Marker {
+    size_t sample;
+    int intensity; // -1: section, 0: Low, 1: Med, 2: High, 3: Very High
+    size_t end;    // last sample of a section, 0 for point markers
+
+    bool operator==(const Marker& other) const {
+        return sample == other.sample && intensity == other.intensity && end == other.end;
+    }
+};
+
+// Total order on markers, by sample first so sorted sets follow the CSV order
+struct MarkerLess {
+    bool operator()(const Marker& a, const Marker& b) const {
+        if (a.sample != b.sample) return a.sample < b.sample;
+        if (a.end != b.end) return a.end < b.end;
+        return a.intensity < b.intensity;
+    }
+};
+
+// Sidecar CSV next to the WAV file, same base name
+std::string markerCsvPath(const std::string& wavFile);
+
+// Parses "sample,intensity[,end]" lines into marks, sorted by sample.
+// contentHash receives a hash of the raw file, 0 when it does not exist.
+bool loadMarkersCsv(const std::string& csvPath, std::vector<Marker>& marks, uint64_t* contentHash = nullptr);
+// Writes marks to a temporary file, fsyncs it and renames it over csvPath so
+// a crash leaves either the old or the new file, never a truncated one
+bool saveMarkersCsv(const std::string& csvPath, const std::vector<Marker>& marks, uint64_t* contentHash = nullptr);
+
+// FNV-1a, used to tie a journal to the CSV it applies to
+uint64_t hashBytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// Writes data to path through a temporary file and an atomic rename
+bool writeFileAtomic(const std::string& path, const std::string& data);
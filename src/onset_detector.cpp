@@ -0,0 +1,172 @@
+#include "onset_detector.h"
+#include "fft.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+bool OnsetDetector::start(const AudioProcessor& source) {
+    if (isRunning() || !source.isLoaded() || source.getNumSamples() == 0) return false;
+    audio = &source;
+    numFrames = (source.getNumSamples() + kHop - 1) / kHop;
+    if (envelopesReady && envelopes.rms.size() == numFrames && envelopes.flux.size() == numFrames) {
+        // A single empty chunk, the peak picking still runs off the UI thread
+        return job.start(1, [](size_t) {}, [this] { finish(); });
+    }
+
+    envelopesReady = false;
+    envelopes.rms.assign(numFrames, 0.0f);
+    envelopes.flux.assign(numFrames, 0.0f);
+    // Chunks write disjoint frame ranges of the envelopes, the last one to
+    // finish turns them into markers
+    size_t numChunks = (numFrames + kChunkFrames - 1) / kChunkFrames;
+    return job.start(numChunks, [this](size_t chunk) { analyzeChunk(chunk); }, [this] { finish(); });
+}
+
+void OnsetDetector::cancel() {
+    job.cancel();
+}
+
+void OnsetDetector::reset() {
+    cancel();
+    envelopes = Envelopes();
+    envelopesReady = false;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    suggestions.clear();
+    hasSuggestions = false;
+}
+
+void OnsetDetector::restoreEnvelopes(Envelopes cached) {
+    if (isRunning()) return;
+    envelopes = std::move(cached);
+    envelopesReady = envelopes.rms.size() == envelopes.flux.size();
+}
+
+bool OnsetDetector::takeSuggestions(std::vector<Marker>& out) {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (!hasSuggestions) return false;
+    out = std::move(suggestions);
+    suggestions.clear();
+    hasSuggestions = false;
+    return true;
+}
+
+void OnsetDetector::analyzeChunk(size_t chunk) {
+    PROFILE_SCOPE("onset chunk");
+    size_t firstFrame = chunk * kChunkFrames;
+    size_t lastFrame = std::min(firstFrame + kChunkFrames, numFrames);
+    size_t numSamples = audio->getNumSamples();
+    size_t numChannels = audio->getNumChannels();
+
+    // The chunk's mixdown with room for the windows hanging over its edges.
+    // One extra frame in front seeds the flux of the first one.
+    size_t startFrame = firstFrame > 0 ? firstFrame - 1 : 0;
+    int64_t spanStart = static_cast<int64_t>(startFrame * kHop) + int64_t(kHop / 2) - int64_t(kFFTSize / 2);
+    size_t spanLength = (lastFrame - startFrame) * kHop + kFFTSize;
+    std::vector<float> mix(spanLength, 0.0f), channel(spanLength);
+    size_t readFrom = static_cast<size_t>(std::max<int64_t>(spanStart, 0));
+    size_t offset = readFrom - spanStart;
+    if (readFrom < numSamples) {
+        size_t count = std::min(spanLength - offset, numSamples - readFrom);
+        float scale = 1.0f / numChannels;
+        for (size_t c = 0; c < numChannels && !job.isCancelled(); ++c) {
+            size_t read = audio->readSamples(c, readFrom, count, channel.data());
+            for (size_t i = 0; i < read; ++i) mix[offset + i] += channel[i] * scale;
+        }
+    }
+
+    FFT fft(kFFTSize);
+    size_t numBins = fft.numBins();
+    std::vector<float> power(numBins), previous(numBins, 0.0f), current(numBins);
+    std::vector<float> hann(kFFTSize), windowed(kFFTSize);
+    for (size_t i = 0; i < kFFTSize; ++i) {
+        hann[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / kFFTSize));
+    }
+    for (size_t frame = startFrame; frame < lastFrame && !job.isCancelled(); ++frame) {
+        const float* window = mix.data() + (frame - startFrame) * kHop;
+
+        // Log-compressed magnitudes, the rise over the previous frame is the flux
+        for (size_t i = 0; i < kFFTSize; ++i) windowed[i] = window[i] * hann[i];
+        fft.powerSpectrum(windowed.data(), power.data());
+        float flux = 0.0f;
+        for (size_t k = 0; k < numBins; ++k) {
+            current[k] = std::log1p(std::sqrt(power[k]));
+            flux += std::max(current[k] - previous[k], 0.0f);
+        }
+        std::swap(previous, current);
+        if (frame < firstFrame) continue;
+
+        // RMS of the hop itself, the middle of the window
+        const float* hop = window + kFFTSize / 2 - kHop / 2;
+        float sum = 0.0f;
+        for (size_t i = 0; i < kHop; ++i) sum += hop[i] * hop[i];
+        envelopes.rms[frame] = std::sqrt(sum / kHop);
+        envelopes.flux[frame] = flux;
+    }
+}
+
+void OnsetDetector::finish() {
+    envelopesReady = true;
+    std::vector<Marker> found = pickOnsets(envelopes, audio->getSampleRate());
+    std::lock_guard<std::mutex> lock(resultMutex);
+    suggestions = std::move(found);
+    hasSuggestions = true;
+}
+
+std::vector<Marker> OnsetDetector::pickOnsets(const Envelopes& envelopes, size_t sampleRate) {
+    const std::vector<float>& flux = envelopes.flux;
+    const std::vector<float>& rms = envelopes.rms;
+    size_t numFrames = flux.size();
+    std::vector<Marker> onsets;
+    if (numFrames < 3) return onsets;
+
+    // Prefix sums give the local mean of every frame in O(1)
+    std::vector<double> prefix(numFrames + 1, 0.0);
+    for (size_t f = 0; f < numFrames; ++f) prefix[f + 1] = prefix[f] + flux[f];
+    double globalMean = prefix[numFrames] / numFrames;
+
+    size_t minGap = std::max<size_t>(1, static_cast<size_t>(kMinGapSeconds * sampleRate / kHop));
+    std::vector<size_t> peaks;
+    for (size_t f = 1; f + 1 < numFrames; ++f) {
+        if (flux[f] <= flux[f - 1] || flux[f] < flux[f + 1]) continue;
+        size_t from = f > kThresholdFrames ? f - kThresholdFrames : 0;
+        size_t to = std::min(f + kThresholdFrames + 1, numFrames);
+        double localMean = (prefix[to] - prefix[from]) / (to - from);
+        if (flux[f] <= kThresholdRatio * localMean + kThresholdFloor * globalMean) continue;
+        // Within the minimum gap the stronger onset wins
+        if (!peaks.empty() && f - peaks.back() < minGap) {
+            if (flux[f] > flux[peaks.back()]) peaks.back() = f;
+            continue;
+        }
+        peaks.push_back(f);
+    }
+    if (peaks.empty()) return onsets;
+
+    // Level of an onset: the loudest hop among it and the few after it, the
+    // window runs ahead of the hop so the onset frame itself may be silent
+    std::vector<float> levels;
+    size_t kept = 0;
+    for (size_t f : peaks) {
+        float loudest = 0.0f;
+        for (size_t g = f; g < std::min(f + 4, numFrames); ++g) loudest = std::max(loudest, rms[g]);
+        float level = 20.0f * std::log10(std::max(loudest, 1e-9f));
+        if (level < kSilenceDb) continue;
+        peaks[kept++] = f;
+        levels.push_back(level);
+    }
+    peaks.resize(kept);
+    if (peaks.empty()) return onsets;
+
+    std::vector<float> sorted = levels;
+    size_t percentile = sorted.size() * 99 / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + percentile, sorted.end());
+    float reference = sorted[percentile];
+
+    onsets.reserve(peaks.size());
+    for (size_t i = 0; i < peaks.size(); ++i) {
+        float relative = levels[i] - reference;
+        int intensity = 0;
+        while (intensity < 3 && relative >= kIntensityDb[intensity]) intensity++;
+        onsets.push_back({peaks[i] * kHop + kHop / 2, intensity, 0});
+    }
+    return onsets;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "audio_processor.h"
+#include "markers.h"
+#include "thread_pool.h"
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+// Proposes point markers where sound events start, with an intensity taken
+// from the loudness right after each onset.
+//
+// One pass over the channel mixdown computes, per hop of kHop samples, the
+// RMS level and the spectral flux (summed rise of the log magnitude
+// spectrum). Chunks of kChunkFrames hops run in parallel, the last one to
+// finish picks the flux peaks and buckets their levels relative to the
+// loudest onsets of the file.
+class OnsetDetector {
+public:
+    static constexpr size_t kFFTSize = 1024;
+    static constexpr size_t kHop = 512;
+    static constexpr size_t kChunkFrames = 2048;
+    // Peak picking: flux above kThresholdRatio times its mean over
+    // kThresholdFrames on each side, plus kThresholdFloor times the file mean
+    static constexpr size_t kThresholdFrames = 16;
+    static constexpr float kThresholdRatio = 1.5f;
+    static constexpr float kThresholdFloor = 1.0f;
+    static constexpr double kMinGapSeconds = 0.1;
+    static constexpr float kSilenceDb = -60.0f;
+    // Intensity 1, 2, 3 from this many dB below the reference level, which
+    // is the 99th percentile of the onset levels
+    static constexpr float kIntensityDb[3] = {-24.0f, -12.0f, -6.0f};
+
+    // Per-hop envelopes of the whole file, frame f covers [f * kHop, (f + 1) * kHop)
+    struct Envelopes {
+        std::vector<float> rms;
+        std::vector<float> flux;
+    };
+
+    // Chunks run on pool, which is shared with the other analyses
+    explicit OnsetDetector(ThreadPool& pool) : job(pool) {}
+    ~OnsetDetector() { cancel(); }
+    OnsetDetector(const OnsetDetector&) = delete;
+    OnsetDetector& operator=(const OnsetDetector&) = delete;
+
+    // Starts a pass over a fully loaded file, false if one is already running.
+    // Only the peak picking runs when envelopes for the file are at hand.
+    bool start(const AudioProcessor& audio);
+    // Stops and discards a running pass
+    void cancel();
+    // Also forgets envelopes and proposals, before switching to another file
+    void reset();
+    bool isRunning() const { return job.isRunning(); }
+    float getProgress() const { return job.getProgress(); }
+
+    // Hands over the proposals of a finished pass, sorted, once
+    bool takeSuggestions(std::vector<Marker>& out);
+    // Envelopes of the last finished pass or restored from a cache
+    bool hasEnvelopes() const { return !isRunning() && envelopesReady; }
+    const Envelopes& getEnvelopes() const { return envelopes; }
+    void restoreEnvelopes(Envelopes cached);
+
+    // Onsets of a set of envelopes, exposed for tools and benchmarks
+    static std::vector<Marker> pickOnsets(const Envelopes& envelopes, size_t sampleRate);
+
+private:
+    void analyzeChunk(size_t chunk);
+    void finish();
+
+    ChunkedJob job;
+    const AudioProcessor* audio = nullptr;
+    Envelopes envelopes;
+    bool envelopesReady = false;
+    size_t numFrames = 0;
+
+    std::mutex resultMutex;
+    std::vector<Marker> suggestions;
+    bool hasSuggestions = false;
+};
@@ -0,0 +1,320 @@
+#include "pcm_decode.h"
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_DECODE_X86 1
+#endif
+
+size_t bytesPerSample(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::UInt8: return 1;
+        case SampleFormat::Int16: return 2;
+        case SampleFormat::Int24: return 3;
+        case SampleFormat::Int32: return 4;
+        case SampleFormat::Float32: return 4;
+        case SampleFormat::Float64: return 8;
+    }
+    return 0;
+}
+
+const char* sampleFormatName(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::UInt8: return "int8";
+        case SampleFormat::Int16: return "int16";
+        case SampleFormat::Int24: return "int24";
+        case SampleFormat::Int32: return "int32";
+        case SampleFormat::Float32: return "float32";
+        case SampleFormat::Float64: return "float64";
+    }
+    return "unknown";
+}
+
+// Scalar kernels, also used for the tails of the vector ones
+
+static void decodeUInt8Scalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = (int(src[i]) - 128) * (1.0f / 128.0f);
+    }
+}
+
+static void decodeInt16Scalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int16_t sample;
+        memcpy(&sample, src + i * 2, 2);
+        dst[i] = sample * (1.0f / 32768.0f);
+    }
+}
+
+static void decodeInt24Scalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* p = src + i * 3;
+        // Build the sample in the top 3 bytes so the shift sign-extends it
+        int32_t sample = int32_t(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24) >> 8;
+        dst[i] = sample * (1.0f / 8388608.0f);
+    }
+}
+
+static void decodeInt32Scalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int32_t sample;
+        memcpy(&sample, src + i * 4, 4);
+        dst[i] = sample * (1.0f / 2147483648.0f);
+    }
+}
+
+static void decodeFloat32(const uint8_t* src, float* dst, size_t count) {
+    memcpy(dst, src, count * sizeof(float));
+}
+
+static void decodeFloat64Scalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        double sample;
+        memcpy(&sample, src + i * 8, 8);
+        dst[i] = static_cast<float>(sample);
+    }
+}
+
+using DecodeKernel = void (*)(const uint8_t*, float*, size_t);
+
+struct DecodeKernels {
+    const char* name;
+    DecodeKernel uint8, int16, int24, int32, float32, float64;
+};
+
+static const DecodeKernels scalarKernels = {
+    "scalar",
+    decodeUInt8Scalar, decodeInt16Scalar, decodeInt24Scalar,
+    decodeInt32Scalar, decodeFloat32, decodeFloat64Scalar
+};
+
+#ifdef PCM_DECODE_X86
+
+// SSE2 kernels, baseline on x86-64
+
+__attribute__((target("sse2")))
+static void decodeUInt8SSE2(const uint8_t* src, float* dst, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128 scale = _mm_set1_ps(1.0f / 128.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo16 = _mm_sub_epi16(_mm_unpacklo_epi8(bytes, zero), bias);
+        __m128i hi16 = _mm_sub_epi16(_mm_unpackhi_epi8(bytes, zero), bias);
+        // Widen to 32 bits by placing each value in the upper half, then shifting down
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16);
+        __m128i c = _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16);
+        __m128i d = _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(c), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(d), scale));
+    }
+    decodeUInt8Scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeInt16SSE2(const uint8_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    decodeInt16Scalar(src + i * 2, dst + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeInt32SSE2(const uint8_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(words), scale));
+    }
+    decodeInt32Scalar(src + i * 4, dst + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void decodeFloat64SSE2(const uint8_t* src, float* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d a = _mm_loadu_pd(reinterpret_cast<const double*>(src + i * 8));
+        __m128d b = _mm_loadu_pd(reinterpret_cast<const double*>(src + i * 8 + 16));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(_mm_cvtpd_ps(a), _mm_cvtpd_ps(b)));
+    }
+    decodeFloat64Scalar(src + i * 8, dst + i, count - i);
+}
+
+// SSE2 has no byte shuffle, 24-bit stays scalar at this level
+static const DecodeKernels sse2Kernels = {
+    "sse2",
+    decodeUInt8SSE2, decodeInt16SSE2, decodeInt24Scalar,
+    decodeInt32SSE2, decodeFloat32, decodeFloat64SSE2
+};
+
+// AVX2 kernels, picked at runtime
+
+__attribute__((target("avx2")))
+static void decodeUInt8AVX2(const uint8_t* src, float* dst, size_t count) {
+    const __m256i bias = _mm256_set1_epi32(128);
+    const __m256 scale = _mm256_set1_ps(1.0f / 128.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+        __m256i words = _mm256_sub_epi32(_mm256_cvtepu8_epi32(bytes), bias);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(words), scale));
+    }
+    decodeUInt8Scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeInt16AVX2(const uint8_t* src, float* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2 + 16));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lo)), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(hi)), scale));
+    }
+    decodeInt16Scalar(src + i * 2, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeInt24AVX2(const uint8_t* src, float* dst, size_t count) {
+    // Moves each 3-byte sample into the top of a 32-bit lane, -1 zeroes the low byte
+    const __m256i shuffle = _mm256_setr_epi8(
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    // Each 16-byte load reads 4 spare bytes, stop early enough to stay in bounds
+    for (; i + 10 <= count; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+        __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m256i words = _mm256_shuffle_epi8(bytes, shuffle);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(words), scale));
+    }
+    decodeInt24Scalar(src + i * 3, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeInt32AVX2(const uint8_t* src, float* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(words), scale));
+    }
+    decodeInt32Scalar(src + i * 4, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void decodeFloat64AVX2(const uint8_t* src, float* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256d a = _mm256_loadu_pd(reinterpret_cast<const double*>(src + i * 8));
+        __m256d b = _mm256_loadu_pd(reinterpret_cast<const double*>(src + i * 8 + 32));
+        __m256 packed = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(a)), _mm256_cvtpd_ps(b), 1);
+        _mm256_storeu_ps(dst + i, packed);
+    }
+    decodeFloat64Scalar(src + i * 8, dst + i, count - i);
+}
+
+static const DecodeKernels avx2Kernels = {
+    "avx2",
+    decodeUInt8AVX2, decodeInt16AVX2, decodeInt24AVX2,
+    decodeInt32AVX2, decodeFloat32, decodeFloat64AVX2
+};
+
+#endif // PCM_DECODE_X86
+
+static const DecodeKernels& selectKernels() {
+#ifdef PCM_DECODE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return avx2Kernels;
+    if (__builtin_cpu_supports("sse2")) return sse2Kernels;
+#endif
+    return scalarKernels;
+}
+
+static const DecodeKernels& activeKernels() {
+    static const DecodeKernels& kernels = selectKernels();
+    return kernels;
+}
+
+static void decodeWith(const DecodeKernels& kernels, SampleFormat format, const uint8_t* src, float* dst, size_t count) {
+    switch (format) {
+        case SampleFormat::UInt8: kernels.uint8(src, dst, count); break;
+        case SampleFormat::Int16: kernels.int16(src, dst, count); break;
+        case SampleFormat::Int24: kernels.int24(src, dst, count); break;
+        case SampleFormat::Int32: kernels.int32(src, dst, count); break;
+        case SampleFormat::Float32: kernels.float32(src, dst, count); break;
+        case SampleFormat::Float64: kernels.float64(src, dst, count); break;
+    }
+}
+
+void decodePCM(SampleFormat format, const uint8_t* src, float* dst, size_t count) {
+    decodeWith(activeKernels(), format, src, dst, count);
+}
+
+void decodePCMScalar(SampleFormat format, const uint8_t* src, float* dst, size_t count) {
+    decodeWith(scalarKernels, format, src, dst, count);
+}
+
+const char* decodeKernelName() {
+    return activeKernels().name;
+}
+
+void deinterleave(const float* src, size_t numChannels, float* const* dst, size_t frames) {
+    if (numChannels == 1) {
+        memcpy(dst[0], src, frames * sizeof(float));
+        return;
+    }
+
+    size_t i = 0;
+#ifdef PCM_DECODE_X86
+    if (numChannels == 2) {
+        // L0 R0 L1 R1 | L2 R2 L3 R3 -> L0 L1 L2 L3 and R0 R1 R2 R3
+        for (; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_loadu_ps(src + i * 2);
+            __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+            _mm_storeu_ps(dst[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(dst[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+#endif
+    for (; i < frames; ++i) {
+        for (size_t c = 0; c < numChannels; ++c) {
+            dst[c][i] = src[i * numChannels + c];
+        }
+    }
+}
+
+void decodePCMPlanar(SampleFormat format, const uint8_t* src, size_t numChannels, float* const* dst, size_t frames) {
+    if (numChannels == 1) {
+        decodePCM(format, src, dst[0], frames);
+        return;
+    }
+
+    // About 32 KB of interleaved floats per pass
+    const size_t chunkFrames = std::max<size_t>(8192 / numChannels, 1);
+    std::vector<float> scratch(chunkFrames * numChannels);
+    std::vector<float*> out(dst, dst + numChannels);
+    size_t frameBytes = bytesPerSample(format) * numChannels;
+    for (size_t start = 0; start < frames; start += chunkFrames) {
+        size_t count = std::min(chunkFrames, frames - start);
+        decodePCM(format, src + start * frameBytes, scratch.data(), count * numChannels);
+        deinterleave(scratch.data(), numChannels, out.data(), count);
+        for (auto& ptr : out) ptr += count;
+    }
+}
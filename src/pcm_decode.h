@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// PCM sample encodings found in WAV data chunks
+enum class SampleFormat {
+    UInt8,   // unsigned, 128 is silence
+    Int16,
+    Int24,   // packed, 3 bytes per sample
+    Int32,
+    Float32,
+    Float64
+};
+
+size_t bytesPerSample(SampleFormat format);
+const char* sampleFormatName(SampleFormat format);
+
+// Converts count little-endian samples at src into float32 at dst, integer
+// formats are scaled to [-1, 1). Uses the widest kernel the CPU supports.
+void decodePCM(SampleFormat format, const uint8_t* src, float* dst, size_t count);
+// Portable reference implementation of decodePCM()
+void decodePCMScalar(SampleFormat format, const uint8_t* src, float* dst, size_t count);
+// Decodes `frames` interleaved frames of numChannels channels into planar
+// buffers, dst[c] receives channel c. Goes through a small scratch buffer so
+// the interleaved floats are deinterleaved while still in cache.
+void decodePCMPlanar(SampleFormat format, const uint8_t* src, size_t numChannels, float* const* dst, size_t frames);
+// Splits interleaved float frames into planar buffers
+void deinterleave(const float* src, size_t numChannels, float* const* dst, size_t frames);
+// Name of the kernel set decodePCM() dispatches to: "avx2", "sse2" or "scalar"
+const char* decodeKernelName();
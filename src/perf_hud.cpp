@@ -0,0 +1,161 @@
+#include "perf_hud.h"
+#include "imgui.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+// Resident set size from /proc, 0 where it is not available
+static size_t residentBytes() {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) return 0;
+    unsigned long pages = 0, resident = 0;
+    int read = fscanf(statm, "%lu %lu", &pages, &resident);
+    fclose(statm);
+    return read == 2 ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+void PerfHud::setVisible(bool show) {
+    visible = show;
+    updateEnabled();
+}
+
+void PerfHud::updateEnabled() {
+    setProfilerEnabled(visible || recording);
+}
+
+PerfHud::Section& PerfHud::section(const char* name, uint32_t thread) {
+    for (auto& s : sections) {
+        if (s.name == name && s.thread == thread) return s;
+    }
+    sections.push_back({name, thread});
+    return sections.back();
+}
+
+void PerfHud::endFrame() {
+    uint64_t now = profilerNowNs();
+    if (!profilerEnabled()) {
+        lastFrameNs = 0;
+        return;
+    }
+    if (lastFrameNs != 0) {
+        frameMs[frameIndex] = (now - lastFrameNs) / 1e6f;
+        frameIndex = (frameIndex + 1) % kHistoryFrames;
+        framesSeen++;
+    }
+    lastFrameNs = now;
+
+    events.clear();
+    profilerCollect(events);
+    droppedEvents += profilerTakeDropped();
+    for (const auto& event : events) {
+        Section& s = section(event.name, event.thread);
+        s.frameNs += event.durationNs;
+        s.frameCalls++;
+    }
+    if (recording) {
+        size_t room = kMaxTraceEvents - std::min(trace.size(), kMaxTraceEvents);
+        trace.insert(trace.end(), events.begin(), events.begin() + std::min(room, events.size()));
+    }
+
+    // Background sections only count in the frames they ran in
+    bool newWindow = framesSeen % kPeakFrames == 0;
+    for (auto& s : sections) {
+        s.lastMs = s.frameNs / 1e6;
+        s.avgMs += (s.lastMs - s.avgMs) * 0.05;
+        s.windowPeakMs = std::max(s.windowPeakMs, s.lastMs);
+        if (newWindow) {
+            s.peakMs = s.windowPeakMs;
+            s.windowPeakMs = 0.0;
+        }
+        s.calls = s.frameCalls;
+        s.frameNs = 0;
+        s.frameCalls = 0;
+    }
+}
+
+bool PerfHud::saveTrace() {
+    char path[64];
+    time_t now = time(nullptr);
+    strftime(path, sizeof(path), "audiomarker-trace-%Y%m%d-%H%M%S.json", localtime(&now));
+    if (!writeChromeTrace(path, trace)) {
+        printf("Failed to write trace %s\n", path);
+        return false;
+    }
+    printf("Saved %zu trace events to %s\n", trace.size(), path);
+    return true;
+}
+
+void PerfHud::draw() {
+    if (!visible) return;
+    ImGuiIO& io = ImGui::GetIO();
+    ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10.0f, 10.0f), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.85f);
+    bool open = true;
+    if (!ImGui::Begin("Performance", &open, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing)) {
+        ImGui::End();
+        if (!open) setVisible(false);
+        return;
+    }
+
+    // Frame times in display order, oldest first
+    size_t count = std::min(framesSeen, kHistoryFrames);
+    float worst = 0.0f, total = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        worst = std::max(worst, frameMs[i]);
+        total += frameMs[i];
+    }
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "avg %.2f ms  max %.2f ms", count ? total / count : 0.0f, worst);
+    size_t offset = count < kHistoryFrames ? 0 : frameIndex;
+    ImGui::PlotLines("##frames", frameMs, (int)count, (int)offset, overlay, 0.0f, std::max(33.3f, worst),
+        ImVec2(360, 60));
+
+    ImGui::Text("%d vertices, %d indices, %d windows", io.MetricsRenderVertices, io.MetricsRenderIndices,
+        io.MetricsRenderWindows);
+    ImGui::Text("RSS %.1f MB", residentBytes() / 1048576.0);
+
+    if (ImGui::BeginTable("##sections", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Section");
+        ImGui::TableSetupColumn("Thread");
+        ImGui::TableSetupColumn("Last ms");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("Peak ms");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableHeadersRow();
+        for (const auto& s : sections) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(s.name);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(profilerThreadName(s.thread).c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", s.lastMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", s.avgMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", std::max(s.peakMs, s.windowPeakMs));
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", s.calls);
+        }
+        ImGui::EndTable();
+    }
+    if (droppedEvents > 0) {
+        ImGui::TextDisabled("%zu events dropped", droppedEvents);
+    }
+
+    if (ImGui::Checkbox("Record trace", &recording)) {
+        if (recording) trace.clear();
+        updateEnabled();
+    }
+    ImGui::SameLine();
+    ImGui::BeginDisabled(trace.empty());
+    if (ImGui::Button("Save trace")) {
+        saveTrace();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::Text("%zu events%s", trace.size(), trace.size() >= kMaxTraceEvents ? " (full)" : "");
+    ImGui::End();
+    if (!open) setVisible(false);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "profiler.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Overlay with the frame time graph, a per-section breakdown of the
+// profiler scopes, draw counts and memory use. Profiling only runs while
+// the overlay is shown or a trace is being recorded.
+class PerfHud {
+public:
+    static constexpr size_t kHistoryFrames = 240;
+    // Sections keep their worst time over this many frames
+    static constexpr size_t kPeakFrames = 120;
+    static constexpr size_t kMaxTraceEvents = size_t(1) << 20;
+
+    bool isVisible() const { return visible; }
+    void setVisible(bool show);
+    // Once per frame before NewFrame: drains what the previous frame and the
+    // background threads recorded and updates the stats
+    void endFrame();
+    // Between NewFrame and Render
+    void draw();
+
+private:
+    struct Section {
+        const char* name;
+        uint32_t thread;
+        uint64_t frameNs = 0;
+        uint32_t frameCalls = 0;
+        double lastMs = 0.0;
+        double avgMs = 0.0;
+        double peakMs = 0.0;
+        double windowPeakMs = 0.0;
+        uint32_t calls = 0;
+    };
+
+    void updateEnabled();
+    Section& section(const char* name, uint32_t thread);
+    bool saveTrace();
+
+    bool visible = false;
+    bool recording = false;
+    std::vector<ProfileEvent> events;
+    std::vector<Section> sections;
+    std::vector<ProfileEvent> trace;
+    size_t droppedEvents = 0;
+
+    float frameMs[kHistoryFrames] = {};
+    size_t frameIndex = 0;
+    size_t framesSeen = 0;
+    uint64_t lastFrameNs = 0;
+};
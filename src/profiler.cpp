@@ -0,0 +1,142 @@
+#include "profiler.h"
+#include "spsc_ring.h"
+#include "markers.h"
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <cinttypes>
+#include <cstdio>
+
+std::atomic<bool> profilerOn{false};
+
+namespace {
+
+struct ThreadRing {
+    SpscRing<ProfileEvent> events{kProfileRingEvents};
+    std::atomic<size_t> dropped{0};
+    std::string name;
+    uint32_t index = 0;
+};
+
+// Rings are only made for threads that record while profiling is on. They
+// outlive their threads so the last events can still be drained, a dead
+// thread's ring goes to the free list and the next new thread takes it over.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadRing>> registry;
+std::vector<ThreadRing*> freeRings;
+
+struct LocalRing {
+    ThreadRing* ring = nullptr;
+    std::string name;
+    ~LocalRing() {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        freeRings.push_back(ring);
+    }
+};
+thread_local LocalRing local;
+
+ThreadRing& threadRing() {
+    if (!local.ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (!freeRings.empty()) {
+            local.ring = freeRings.back();
+            freeRings.pop_back();
+        } else {
+            registry.push_back(std::make_unique<ThreadRing>());
+            local.ring = registry.back().get();
+            local.ring->index = static_cast<uint32_t>(registry.size() - 1);
+        }
+        local.ring->name = local.name.empty() ? "thread " + std::to_string(local.ring->index) : local.name;
+    }
+    return *local.ring;
+}
+
+}
+
+void setProfilerEnabled(bool enabled) {
+    profilerOn.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t profilerNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void profilerRecord(const char* name, uint64_t startNs, uint64_t endNs) {
+    ThreadRing& ring = threadRing();
+    ProfileEvent* slot = ring.events.beginWrite();
+    if (!slot) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    *slot = {name, startNs, endNs - startNs, ring.index};
+    ring.events.commitWrite();
+}
+
+void profilerSetThreadName(const char* name) {
+    // Kept until the thread first records, naming costs no ring
+    local.name = name;
+    if (local.ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        local.ring->name = name;
+    }
+}
+
+void profilerCollect(std::vector<ProfileEvent>& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& ring : registry) {
+        while (const ProfileEvent* event = ring->events.beginRead()) {
+            out.push_back(*event);
+            ring->events.commitRead();
+        }
+    }
+}
+
+size_t profilerTakeDropped() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t dropped = 0;
+    for (auto& ring : registry) {
+        dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+std::string profilerThreadName(uint32_t thread) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return thread < registry.size() ? registry[thread]->name : std::string();
+}
+
+bool writeChromeTrace(const std::string& path, const std::vector<ProfileEvent>& events) {
+    std::string json = "{\"traceEvents\":[\n";
+    char line[256];
+    uint32_t numThreads;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        numThreads = static_cast<uint32_t>(registry.size());
+    }
+    for (uint32_t t = 0; t < numThreads; ++t) {
+        snprintf(line, sizeof(line),
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+            t, profilerThreadName(t).c_str());
+        json += line;
+    }
+    // Complete events, timestamps in microseconds from the first event
+    uint64_t origin = UINT64_MAX;
+    for (const auto& event : events) origin = std::min(origin, event.startNs);
+    for (size_t i = 0; i < events.size(); ++i) {
+        const ProfileEvent& event = events[i];
+        snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+            event.name, event.thread, (event.startNs - origin) / 1e3, event.durationNs / 1e3,
+            i + 1 < events.size() ? "," : "");
+        json += line;
+    }
+    if (events.empty() && numThreads > 0) {
+        // Drop the comma after the last thread name
+        json.resize(json.size() - 2);
+        json += "\n";
+    }
+    json += "]}\n";
+    return writeFileAtomic(path, json);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Scoped timers for the hot paths. Every thread records into its own
+// single-producer ring, the UI thread drains them all once per frame. While
+// profiling is off a scope costs one relaxed load and a branch.
+struct ProfileEvent {
+    const char* name; // string literal, compared by address
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t thread;  // ring index, reused once its thread exits, see profilerThreadName()
+};
+
+// Events per thread between two drains, later ones are dropped and counted
+static constexpr size_t kProfileRingEvents = 8192;
+
+extern std::atomic<bool> profilerOn;
+
+inline bool profilerEnabled() { return profilerOn.load(std::memory_order_relaxed); }
+void setProfilerEnabled(bool enabled);
+uint64_t profilerNowNs();
+void profilerRecord(const char* name, uint64_t startNs, uint64_t endNs);
+// Names the calling thread in the HUD and in traces
+void profilerSetThreadName(const char* name);
+
+// Appends every event recorded since the last call, UI thread only
+void profilerCollect(std::vector<ProfileEvent>& out);
+// Events lost to full rings since the last call
+size_t profilerTakeDropped();
+std::string profilerThreadName(uint32_t thread);
+
+// Chrome trace event format, opens in chrome://tracing and Perfetto
+bool writeChromeTrace(const std::string& path, const std::vector<ProfileEvent>& events);
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* scopeName) {
+        if (profilerEnabled()) {
+            name = scopeName;
+            startNs = profilerNowNs();
+        }
+    }
+    ~ProfileScope() {
+        if (name) profilerRecord(name, startNs, profilerNowNs());
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name = nullptr;
+    uint64_t startNs = 0;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing block under name, a string literal
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
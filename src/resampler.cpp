@@ -0,0 +1,180 @@
+#include "resampler.h"
+#include "profiler.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_X86 1
+#endif
+
+// Rows are padded to a multiple of this so the kernels need no tail loop
+static constexpr size_t kTapAlign = 8;
+
+static float dotScalar(const float* a, const float* b, size_t count) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+struct ResampleKernels {
+    const char* name;
+    float (*dot)(const float*, const float*, size_t);
+};
+
+static const ResampleKernels scalarKernels = {"scalar", dotScalar};
+
+#ifdef RESAMPLER_X86
+
+// count is a multiple of kTapAlign, two accumulators hide the add latency
+__attribute__((target("avx2")))
+static float dotAVX2(const float* a, const float* b, size_t count) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    for (; i < count; i += 8) {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+static const ResampleKernels avx2Kernels = {"avx2", dotAVX2};
+
+#endif // RESAMPLER_X86
+
+static const ResampleKernels& selectKernels() {
+#ifdef RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return avx2Kernels;
+#endif
+    return scalarKernels;
+}
+
+static const ResampleKernels& kernels() {
+    static const ResampleKernels& active = selectKernels();
+    return active;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the window
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+Resampler::Resampler(size_t source, size_t target) : sourceRate(source), targetRate(target) {
+    uint64_t divisor = std::gcd<uint64_t>(std::max<size_t>(source, 1), std::max<size_t>(target, 1));
+    up = std::max<size_t>(target, 1) / divisor;
+    down = std::max<size_t>(source, 1) / divisor;
+    if (isIdentity()) return;
+
+    // Cutoff in cycles per input sample, below the lower Nyquist rate. The
+    // filter spans kZeroCrossings of its sinc on each side, so it gets
+    // longer when downsampling.
+    double cutoff = 0.5 * kCutoff * std::min(1.0, static_cast<double>(up) / down);
+    size_t half = static_cast<size_t>(std::ceil(kZeroCrossings / (2.0 * cutoff)));
+    taps = (2 * half + kTapAlign - 1) / kTapAlign * kTapAlign;
+    phases = static_cast<size_t>(std::min<uint64_t>(up, kMaxPhases));
+
+    // Tap k reads input sample base - (taps / 2 - 1) + k, the output instant
+    // is frac past base
+    double window = taps / 2.0;
+    double norm = besselI0(kKaiserBeta);
+    coefficients.assign((phases + 1) * taps, 0.0f);
+    for (size_t row = 0; row <= phases; ++row) {
+        double frac = static_cast<double>(row) / phases;
+        float* coeffs = coefficients.data() + row * taps;
+        double sum = 0.0;
+        for (size_t k = 0; k < taps; ++k) {
+            double t = static_cast<double>(k) - (taps / 2.0 - 1.0) - frac;
+            double x = t / window;
+            if (std::fabs(x) >= 1.0) continue;
+            double arg = 2.0 * M_PI * cutoff * t;
+            double sinc = std::fabs(arg) < 1e-12 ? 1.0 : std::sin(arg) / arg;
+            double value = 2.0 * cutoff * sinc * besselI0(kKaiserBeta * std::sqrt(1.0 - x * x)) / norm;
+            coeffs[k] = static_cast<float>(value);
+            sum += value;
+        }
+        // Unity gain at DC for every phase
+        for (size_t k = 0; k < taps; ++k) coeffs[k] = static_cast<float>(coeffs[k] / sum);
+    }
+}
+
+const char* Resampler::kernelName() {
+    return kernels().name;
+}
+
+size_t Resampler::readyFrames(size_t sourceSamples) const {
+    if (isIdentity()) return sourceSamples;
+    // The last tap of frame n reads floor(n * down / up) + taps / 2
+    if (sourceSamples <= taps / 2) return 0;
+    return ((uint64_t(sourceSamples) - taps / 2) * up + down - 1) / down;
+}
+
+Marker Resampler::toTarget(const Marker& mark) const {
+    Marker mapped = mark;
+    mapped.sample = toTarget(mark.sample);
+    if (mark.end != 0) {
+        // The end is the last sample, the section covers up to the next one
+        size_t next = toTarget(mark.end + 1);
+        mapped.end = std::max<size_t>(std::max(next, mapped.sample + 1) - 1, 1);
+    }
+    return mapped;
+}
+
+void Resampler::process(const AudioProcessor& audio, size_t channel, size_t first, size_t count,
+                        float* out, std::vector<float>& window) const {
+    if (count == 0) return;
+    if (isIdentity()) {
+        size_t read = audio.readSamples(channel, first, count, out);
+        std::fill(out + read, out + count, 0.0f);
+        return;
+    }
+
+    // Every input sample the range needs, zero where there is none
+    int64_t lead = static_cast<int64_t>(taps / 2) - 1;
+    int64_t firstInput = static_cast<int64_t>(uint64_t(first) * down / up) - lead;
+    int64_t lastInput = static_cast<int64_t>(uint64_t(first + count - 1) * down / up) + static_cast<int64_t>(taps / 2);
+    window.assign(static_cast<size_t>(lastInput - firstInput + 1), 0.0f);
+    int64_t readFrom = std::max<int64_t>(firstInput, 0);
+    int64_t readTo = std::min<int64_t>(lastInput + 1, static_cast<int64_t>(audio.getNumSamples()));
+    if (readTo > readFrom) {
+        audio.readSamples(channel, static_cast<size_t>(readFrom), static_cast<size_t>(readTo - readFrom),
+                          window.data() + (readFrom - firstInput));
+    }
+
+    const ResampleKernels& active = kernels();
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t position = uint64_t(first + i) * down;
+        int64_t base = static_cast<int64_t>(position / up);
+        uint64_t phase = position % up;
+        size_t row = phases == up ? phase : (phase * phases + up / 2) / up;
+        out[i] = active.dot(coefficients.data() + row * taps, window.data() + (base - lead - firstInput), taps);
+    }
+}
+
+void Resampler::processParallel(ThreadPool& pool, const AudioProcessor& audio, size_t channel,
+                                size_t first, size_t count, float* out) const {
+    // Each block reads its own window and writes its own part of out
+    for (size_t offset = 0; offset < count; offset += kBlockFrames) {
+        pool.submit([this, &audio, channel, first, count, out, offset] {
+            PROFILE_SCOPE("resample block");
+            std::vector<float> window;
+            size_t frames = std::min(kBlockFrames, count - offset);
+            process(audio, channel, first + offset, frames, out + offset, window);
+        });
+    }
+    pool.wait();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "audio_processor.h"
+#include "markers.h"
+#include "thread_pool.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Sample rate conversion by the rational factor targetRate / sourceRate with
+// a polyphase windowed-sinc filter.
+//
+// The rates are reduced to L / M, output frame n sits at input position
+// n * M / L: the filter phase is taken from the remainder, so every frame is
+// computed on its own from the input around it. Any range of the output can
+// be produced without state, pieces of it match the whole exactly, and
+// blocks of a long range can run in parallel. Ratios needing more than
+// kMaxPhases phases use the nearest of kMaxPhases + 1 instead.
+class Resampler {
+public:
+    // Filter zero crossings on each side of the output instant
+    static constexpr size_t kZeroCrossings = 32;
+    static constexpr size_t kMaxPhases = 1024;
+    // Passband edge as a fraction of the lower of the two Nyquist rates
+    static constexpr double kCutoff = 0.92;
+    // Kaiser window shape, about 90 dB of stopband attenuation
+    static constexpr double kKaiserBeta = 8.6;
+    // Output frames per task of resampleParallel()
+    static constexpr size_t kBlockFrames = 1 << 15;
+
+    // Passes samples through unchanged
+    Resampler() : Resampler(1, 1) {}
+    Resampler(size_t sourceRate, size_t targetRate);
+
+    size_t getSourceRate() const { return sourceRate; }
+    size_t getTargetRate() const { return targetRate; }
+    bool isIdentity() const { return up == down; }
+    size_t getTaps() const { return taps; }
+
+    // Sample index mapping, to the nearest frame. Going to the target and
+    // back is exact whenever the target rate is at least the source rate.
+    size_t toTarget(size_t sourceSample) const { return (uint64_t(sourceSample) * up + down / 2) / down; }
+    size_t toSource(size_t targetFrame) const { return (uint64_t(targetFrame) * down + up / 2) / up; }
+    // Output frames computable from the first sourceSamples input samples
+    size_t readyFrames(size_t sourceSamples) const;
+    // Markers moved to the target rate, sections keep covering the same audio
+    Marker toTarget(const Marker& mark) const;
+
+    // Fills out with output frames [first, first + count) of a channel, input
+    // past getLoadedSamples() or the file reads as silence. window is scratch
+    // space, kept by the caller so repeated calls don't allocate.
+    void process(const AudioProcessor& audio, size_t channel, size_t first, size_t count,
+                 float* out, std::vector<float>& window) const;
+    // Same, split into kBlockFrames blocks run on pool
+    void processParallel(ThreadPool& pool, const AudioProcessor& audio, size_t channel,
+                         size_t first, size_t count, float* out) const;
+
+    // Name of the kernel set the filter runs on: "avx2" or "scalar"
+    static const char* kernelName();
+
+private:
+    size_t sourceRate;
+    size_t targetRate;
+    // Reduced ratio, output frames per `down` input samples
+    uint64_t up;
+    uint64_t down;
+    size_t taps = 0;
+    size_t phases = 0;
+    // phases + 1 rows of taps coefficients, row r is for the fractional
+    // input position r / phases
+    std::vector<float> coefficients;
+};
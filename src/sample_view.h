@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+
+// Copies of at least this many samples are reported in debug builds
+constexpr size_t kLargeSampleCopy = 1 << 20;
+
+#ifdef AUDIOMARKER_DEBUG
+// Counts large sample-buffer copies and logs each of them
+inline void reportSampleCopy(size_t count) {
+    static std::atomic<size_t> largeCopies{0};
+    if (count >= kLargeSampleCopy) {
+        size_t total = ++largeCopies;
+        fprintf(stderr, "Large sample copy: %zu samples (%zu so far)\n", count, total);
+    }
+}
+#else
+inline void reportSampleCopy(size_t) {}
+#endif
+
+// Non-owning read-only view over contiguous samples. Views are cheap to pass
+// by value; the only way to get an owning buffer out of one is copy().
+class SampleView {
+public:
+    SampleView() = default;
+    SampleView(const float* data, size_t size) : ptr(data), count(size) {}
+    SampleView(const std::vector<float>& samples) : ptr(samples.data()), count(samples.size()) {}
+
+    const float* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const float* begin() const { return ptr; }
+    const float* end() const { return ptr + count; }
+    const float& operator[](size_t i) const { return ptr[i]; }
+
+    // View of [offset, offset + length), clamped to the end of this view
+    SampleView subview(size_t offset, size_t length) const {
+        offset = std::min(offset, count);
+        return SampleView(ptr + offset, std::min(length, count - offset));
+    }
+
+    std::vector<float> copy() const {
+        reportSampleCopy(count);
+        return std::vector<float>(begin(), end());
+    }
+
+private:
+    const float* ptr = nullptr;
+    size_t count = 0;
+};
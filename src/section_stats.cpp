@@ -0,0 +1,390 @@
+#include "section_stats.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SECTION_STATS_X86 1
+#endif
+
+// Sections handed to a task at once by computeSections()
+static constexpr size_t kSectionsPerTask = 256;
+
+struct BlockSums {
+    float energy;
+    float peak;
+    uint32_t crossings;
+};
+
+// A crossing is a sign change between neighbouring samples, prev is the
+// sample before x[0] and equals x[0] at the start of the file
+static BlockSums sumBlockScalar(const float* x, size_t count, float prev) {
+    BlockSums sums{0.0f, 0.0f, 0};
+    bool sign = std::signbit(prev);
+    for (size_t i = 0; i < count; ++i) {
+        sums.energy += x[i] * x[i];
+        sums.peak = std::max(sums.peak, std::fabs(x[i]));
+        bool negative = std::signbit(x[i]);
+        sums.crossings += negative != sign;
+        sign = negative;
+    }
+    return sums;
+}
+
+static float maxScalar(const float* x, size_t count) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < count; ++i) peak = std::max(peak, x[i]);
+    return peak;
+}
+
+struct StatsKernels {
+    const char* name;
+    BlockSums (*sumBlock)(const float*, size_t, float);
+    float (*max)(const float*, size_t);
+};
+
+static const StatsKernels scalarKernels = {"scalar", sumBlockScalar, maxScalar};
+
+#ifdef SECTION_STATS_X86
+
+__attribute__((target("avx2")))
+static float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2")))
+static float horizontalMax(__m256 v) {
+    __m128 peak = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+    peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, 1));
+    return _mm_cvtss_f32(peak);
+}
+
+// Sign bits come out of movemask, each lane is compared with the lane
+// before it by shifting the mask in the previous sign
+__attribute__((target("avx2")))
+static BlockSums sumBlockAVX2(const float* x, size_t count, float prev) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 energy = _mm256_setzero_ps();
+    __m256 peak = _mm256_setzero_ps();
+    uint32_t signs = std::signbit(prev) ? 1u : 0u;
+    uint32_t crossings = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(x + i);
+        energy = _mm256_add_ps(energy, _mm256_mul_ps(v, v));
+        peak = _mm256_max_ps(peak, _mm256_andnot_ps(signMask, v));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(v));
+        crossings += __builtin_popcount((mask ^ ((mask << 1) | signs)) & 0xFFu);
+        signs = mask >> 7;
+    }
+    BlockSums sums = sumBlockScalar(x + i, count - i, i > 0 ? x[i - 1] : prev);
+    sums.energy += horizontalSum(energy);
+    sums.peak = std::max(sums.peak, horizontalMax(peak));
+    sums.crossings += crossings;
+    return sums;
+}
+
+__attribute__((target("avx2")))
+static float maxAVX2(const float* x, size_t count) {
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) peak = _mm256_max_ps(peak, _mm256_loadu_ps(x + i));
+    return std::max(horizontalMax(peak), maxScalar(x + i, count - i));
+}
+
+static const StatsKernels avx2Kernels = {"avx2", sumBlockAVX2, maxAVX2};
+
+#endif // SECTION_STATS_X86
+
+static const StatsKernels& selectKernels() {
+#ifdef SECTION_STATS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return avx2Kernels;
+#endif
+    return scalarKernels;
+}
+
+static const StatsKernels& kernels() {
+    static const StatsKernels& active = selectKernels();
+    return active;
+}
+
+// Transposed direct form II, in double so the low shelf pole stays put
+struct Biquad {
+    double b0, b1, b2, a1, a2;
+    double z1 = 0.0, z2 = 0.0;
+
+    float process(float x) {
+        double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return static_cast<float>(y);
+    }
+};
+
+// BS.1770 pre-filter (high shelf) and RLB high-pass, designed for any rate
+// from the analog prototypes the 48 kHz coefficients of the standard are
+// taken from
+static void kWeightingFilters(double rate, Biquad& shelf, Biquad& highpass) {
+    double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+    double k = std::tan(M_PI * f0 / rate);
+    double vh = std::pow(10.0, gain / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf = {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+             2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    highpass = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+}
+
+static float toDb(double power) {
+    return power > 0.0 ? std::max(static_cast<float>(10.0 * std::log10(power)), SectionStats::kSilenceDb)
+                       : SectionStats::kSilenceDb;
+}
+
+const char* SectionStats::kernelName() {
+    return kernels().name;
+}
+
+// Sets up a pass and returns its number of chunks, 0 when there is nothing
+// to start
+size_t SectionStats::prepare(const AudioProcessor& source) {
+    if (isRunning() || !source.isLoaded() || source.getNumSamples() == 0) return 0;
+    update();
+    size_t total = source.getNumSamples();
+    if (ready && audio == &source && total == numSamples) return 0;
+    bool extend = ready && audio == &source && total > numSamples;
+    if (!extend) {
+        // Another file, or the same one again from scratch
+        audio = &source;
+        channels.assign(source.getNumChannels(), Channel());
+        numSamples = 0;
+        ready = false;
+    }
+    // Every whole block stays, the last partial one is computed again
+    passFirstBlock = numSamples / kBlockSamples;
+    passBlocks = (total + kBlockSamples - 1) / kBlockSamples;
+    passSamples = total;
+    passDone = false;
+    size_t count = passBlocks - passFirstBlock;
+    pass.resize(channels.size());
+    for (auto& range : pass) {
+        range.energy.assign(count, 0.0);
+        range.weighted.assign(count, 0.0);
+        range.crossings.assign(count, 0);
+        range.peaks.assign(count, 0.0f);
+    }
+    return (count + kChunkBlocks - 1) / kChunkBlocks;
+}
+
+bool SectionStats::start(const AudioProcessor& source) {
+    size_t numChunks = prepare(source);
+    if (numChunks == 0) return false;
+    // Chunks write disjoint blocks, update() adds them up
+    return job.start(numChunks, [this](size_t chunk) { analyzeChunk(chunk); }, [this] { passDone = true; });
+}
+
+bool SectionStats::build(const AudioProcessor& source) {
+    size_t numChunks = prepare(source);
+    if (numChunks == 0) return false;
+    job.run(numChunks, [this](size_t chunk) { analyzeChunk(chunk); }, [this] { passDone = true; });
+    update();
+    return ready;
+}
+
+bool SectionStats::update() {
+    if (isRunning() || !passDone) return false;
+    passDone = false;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        Channel& channel = channels[c];
+        const BlockRange& range = pass[c];
+        // Entry passFirstBlock holds the whole blocks before the pass
+        channel.energy.resize(passBlocks + 1, 0.0);
+        channel.weighted.resize(passBlocks + 1, 0.0);
+        channel.crossings.resize(passBlocks + 1, 0);
+        channel.peaks.resize(passBlocks, 0.0f);
+        for (size_t b = passFirstBlock; b < passBlocks; ++b) {
+            size_t i = b - passFirstBlock;
+            channel.energy[b + 1] = channel.energy[b] + range.energy[i];
+            channel.weighted[b + 1] = channel.weighted[b] + range.weighted[i];
+            channel.crossings[b + 1] = channel.crossings[b] + range.crossings[i];
+            channel.peaks[b] = range.peaks[i];
+        }
+    }
+    numSamples = passSamples;
+    ready = true;
+    return true;
+}
+
+void SectionStats::cancel() {
+    job.cancel();
+    passDone = false;
+}
+
+void SectionStats::reset() {
+    cancel();
+    audio = nullptr;
+    channels.clear();
+    pass.clear();
+    numSamples = 0;
+    ready = false;
+}
+
+void SectionStats::analyzeChunk(size_t chunk) {
+    PROFILE_SCOPE("section stats chunk");
+    size_t firstBlock = passFirstBlock + chunk * kChunkBlocks;
+    size_t lastBlock = std::min(firstBlock + kChunkBlocks, passBlocks);
+    size_t startSample = firstBlock * kBlockSamples;
+    size_t endSample = std::min(lastBlock * kBlockSamples, passSamples);
+
+    // Read from a little earlier so the filters settle and the first block
+    // has the sample before it
+    double rate = static_cast<double>(audio->getSampleRate());
+    size_t settle = std::max<size_t>(static_cast<size_t>(kFilterSettleSeconds * rate), 1);
+    size_t readFrom = startSample - std::min(startSample, settle);
+    std::vector<float> samples(endSample - readFrom), filtered(endSample - readFrom);
+    const StatsKernels& active = kernels();
+
+    for (size_t c = 0; c < channels.size() && !job.isCancelled(); ++c) {
+        BlockRange& range = pass[c];
+        size_t read = audio->readSamples(c, readFrom, samples.size(), samples.data());
+        std::fill(samples.begin() + read, samples.end(), 0.0f);
+        Biquad shelf, highpass;
+        kWeightingFilters(rate, shelf, highpass);
+        for (size_t i = 0; i < samples.size(); ++i) filtered[i] = highpass.process(shelf.process(samples[i]));
+
+        for (size_t b = firstBlock; b < lastBlock; ++b) {
+            size_t offset = b * kBlockSamples - readFrom;
+            size_t count = std::min(kBlockSamples, endSample - b * kBlockSamples);
+            float prev = offset > 0 ? samples[offset - 1] : samples[offset];
+            BlockSums sums = active.sumBlock(samples.data() + offset, count, prev);
+            size_t i = b - passFirstBlock;
+            range.energy[i] = sums.energy;
+            range.crossings[i] = sums.crossings;
+            range.peaks[i] = sums.peak;
+            range.weighted[i] = active.sumBlock(filtered.data() + offset, count, 0.0f).energy;
+        }
+    }
+}
+
+SectionStats::Stats SectionStats::compute(size_t start, size_t end) const {
+    Stats stats;
+    stats.start = start;
+    stats.end = end;
+    if (!isReady()) return stats;
+    end = std::min(end, numSamples);
+    if (start >= end) return stats;
+    size_t count = end - start;
+    stats.duration = static_cast<double>(count) / audio->getSampleRate();
+
+    // Whole blocks come from the sums, the partial ones at the edges are
+    // read. A block's crossings include the pair across its first sample,
+    // so the block starting at the range start is read as well.
+    size_t firstBlock = start / kBlockSamples + 1;
+    size_t lastBlock = end / kBlockSamples;
+    if (firstBlock >= lastBlock) firstBlock = lastBlock = end / kBlockSamples;
+    double energy = 0.0, weighted = 0.0;
+    uint64_t crossings = 0;
+    float peak = 0.0f;
+    const StatsKernels& active = kernels();
+
+    for (size_t c = 0; c < channels.size(); ++c) {
+        const Channel& channel = channels[c];
+        if (firstBlock < lastBlock) {
+            energy += channel.energy[lastBlock] - channel.energy[firstBlock];
+            weighted += channel.weighted[lastBlock] - channel.weighted[firstBlock];
+            crossings += channel.crossings[lastBlock] - channel.crossings[firstBlock];
+            peak = std::max(peak, active.max(channel.peaks.data() + firstBlock, lastBlock - firstBlock));
+        }
+
+        // At most a block on each side, or the whole range when it is
+        // shorter than two. The pair across the range start is not counted.
+        auto addEdge = [&](size_t from, size_t to) {
+            if (from >= to) return;
+            float edge[kBlockSamples * 2 + 1];
+            size_t before = from > start ? 1 : 0;
+            size_t read = audio->readSamples(c, from - before, to - from + before, edge);
+            if (read <= before) return;
+            BlockSums sums = active.sumBlock(edge + before, read - before, edge[0]);
+            energy += sums.energy;
+            crossings += sums.crossings;
+            peak = std::max(peak, sums.peak);
+            // The filtered samples are gone, a partial block gets its share
+            // of the block's weighted energy
+            for (size_t b = from / kBlockSamples; b * kBlockSamples < to; ++b) {
+                size_t overlap = std::min(to, (b + 1) * kBlockSamples) - std::max(from, b * kBlockSamples);
+                weighted += (channel.weighted[b + 1] - channel.weighted[b]) * overlap / kBlockSamples;
+            }
+        };
+        addEdge(start, std::min(firstBlock * kBlockSamples, end));
+        addEdge(std::max(lastBlock * kBlockSamples, start), end);
+    }
+
+    size_t numChannels = std::max<size_t>(channels.size(), 1);
+    double meanSquare = energy / (static_cast<double>(count) * numChannels);
+    stats.peakDb = toDb(static_cast<double>(peak) * peak);
+    stats.rmsDb = toDb(meanSquare);
+    stats.crestDb = meanSquare > 0.0 ? stats.peakDb - stats.rmsDb : 0.0f;
+    stats.zeroCrossingRate = static_cast<float>(crossings / stats.duration / numChannels);
+    // Channels are summed unweighted, the file doesn't say which are surround
+    stats.loudness = std::max(toDb(weighted / count) - 0.691f, kSilenceDb);
+    return stats;
+}
+
+std::vector<SectionStats::Stats> SectionStats::computeSections(const std::vector<Marker>& marks) {
+    std::vector<const Marker*> sections;
+    for (const Marker& mark : marks) {
+        if (mark.end != 0) sections.push_back(&mark);
+    }
+    std::vector<Stats> results(sections.size());
+    if (!isReady()) {
+        for (size_t i = 0; i < sections.size(); ++i) {
+            results[i].start = sections[i]->sample;
+            results[i].end = sections[i]->end + 1;
+        }
+        return results;
+    }
+    // Each task fills its own slots
+    TaskGroup tasks(job.getPool());
+    for (size_t first = 0; first < sections.size(); first += kSectionsPerTask) {
+        tasks.submit([&, first] {
+            size_t last = std::min(first + kSectionsPerTask, sections.size());
+            for (size_t i = first; i < last; ++i) {
+                results[i] = compute(sections[i]->sample, sections[i]->end + 1);
+            }
+        });
+    }
+    tasks.wait();
+    return results;
+}
+
+const char* SectionStats::csvHeader() {
+    return "file,start,end,duration,peak_db,rms_db,crest_db,zero_crossing_rate,loudness_lufs\n";
+}
+
+void SectionStats::appendCsvRow(std::string& out, const std::string& file, const Stats& stats) {
+    char line[1024];
+    snprintf(line, sizeof(line), "%s,%zu,%zu,%.6f,%.2f,%.2f,%.2f,%.1f,%.2f\n",
+        file.c_str(), stats.start, stats.end, stats.duration, stats.peakDb, stats.rmsDb,
+        stats.crestDb, stats.zeroCrossingRate, stats.loudness);
+    out += line;
+}
+
+std::string sectionStatsPath(const std::string& wavFile) {
+    std::string path = wavFile;
+    size_t dotPos = path.find_last_of('.');
+    if (dotPos != std::string::npos) {
+        path = path.substr(0, dotPos);
+    }
+    return path + ".stats.csv";
+}
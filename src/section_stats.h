@@ -0,0 +1,116 @@
+#pragma once
+#include "audio_processor.h"
+#include "markers.h"
+#include "thread_pool.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Level statistics of sections, or of any range of a loaded file.
+//
+// One pass over the file sums, per channel and block of kBlockSamples, the
+// energy, the K-weighted energy of ITU-R BS.1770 and the zero crossings,
+// kept as prefix sums, plus each block's absolute peak. Chunks of
+// kChunkBlocks blocks run in parallel. A range then costs two lookups per
+// sum, a max over its block peaks and the partial blocks at its edges, cheap
+// enough to follow a section while it is dragged.
+//
+// When a followed file grows, a pass only computes the blocks from the old
+// last partial one on and appends them to the sums. The workers write those
+// blocks aside, update() folds them in on the UI thread, so the old sums
+// stay readable while the pass runs.
+class SectionStats {
+public:
+    static constexpr size_t kBlockSamples = 64;
+    static constexpr size_t kChunkBlocks = 4096;
+    // The K-weighting filters of a chunk start this early from rest, their
+    // state has converged to the sequential one by the chunk's first sample
+    static constexpr double kFilterSettleSeconds = 0.1;
+    static constexpr float kSilenceDb = -120.0f;
+
+    struct Stats {
+        size_t start = 0;
+        size_t end = 0;           // one past the last sample
+        double duration = 0.0;    // seconds
+        float peakDb = kSilenceDb;
+        float rmsDb = kSilenceDb; // all channels together
+        float crestDb = 0.0f;
+        float zeroCrossingRate = 0.0f; // crossings per second, channel average
+        float loudness = kSilenceDb;   // LUFS, ungated
+    };
+
+    // Chunks and section batches run on pool, which may be shared
+    explicit SectionStats(ThreadPool& pool) : job(pool) {}
+    ~SectionStats() { cancel(); }
+    SectionStats(const SectionStats&) = delete;
+    SectionStats& operator=(const SectionStats&) = delete;
+
+    // Starts a pass over a fully loaded file on the pool, false if one is
+    // already running. Sums of the same file, shorter, are extended.
+    bool start(const AudioProcessor& audio);
+    // Same pass on the calling thread, for tools that run files in parallel
+    bool build(const AudioProcessor& audio);
+    // Folds a finished pass into the sums, UI thread, once per frame.
+    // Returns true when the sums changed.
+    bool update();
+    // Stops and discards a running pass
+    void cancel();
+    // Also forgets the sums, before switching to another file
+    void reset();
+    bool isRunning() const { return job.isRunning(); }
+    // Sums are readable, also while a pass extends them
+    bool isReady() const { return ready; }
+    float getProgress() const { return job.getProgress(); }
+    // Samples the sums cover, a followed file may have grown since
+    size_t getNumSamples() const { return isReady() ? numSamples : 0; }
+
+    // Statistics of [start, end), clamped to what the pass covers
+    Stats compute(size_t start, size_t end) const;
+    // Statistics of every section among marks, in their order, spread over
+    // the pool. Sections include their end sample.
+    std::vector<Stats> computeSections(const std::vector<Marker>& marks);
+
+    // CSV of section statistics, one row per section
+    static const char* csvHeader();
+    static void appendCsvRow(std::string& out, const std::string& file, const Stats& stats);
+    // Name of the kernel set the sums run on: "avx2" or "scalar"
+    static const char* kernelName();
+
+private:
+    struct Channel {
+        // Prefix sums, entry b covers blocks [0, b)
+        std::vector<double> energy;
+        std::vector<double> weighted;
+        std::vector<uint64_t> crossings;
+        std::vector<float> peaks;
+    };
+    // Plain sums of the blocks a pass computes, entry i is block
+    // passFirstBlock + i
+    struct BlockRange {
+        std::vector<double> energy;
+        std::vector<double> weighted;
+        std::vector<uint64_t> crossings;
+        std::vector<float> peaks;
+    };
+
+    size_t prepare(const AudioProcessor& audio);
+    void analyzeChunk(size_t chunk);
+
+    ChunkedJob job;
+    const AudioProcessor* audio = nullptr;
+    std::vector<Channel> channels;
+    size_t numSamples = 0;
+    bool ready = false;
+
+    // The pass: blocks [passFirstBlock, passBlocks) of the first passSamples
+    // samples, passDone once every chunk is in
+    std::vector<BlockRange> pass;
+    size_t passFirstBlock = 0;
+    size_t passBlocks = 0;
+    size_t passSamples = 0;
+    bool passDone = false;
+};
+
+// Section statistics CSV next to the WAV file, "<name>.stats.csv"
+std::string sectionStatsPath(const std::string& wavFile);
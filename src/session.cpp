@@ -0,0 +1,143 @@
+#include "session.h"
+#include "sidecar.h"
+#include "profiler.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace fs = std::filesystem;
+
+static std::string lowerExtension(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
+
+static bool isAudioPath(const fs::path& path) {
+    std::string ext = lowerExtension(path);
+    return ext == ".wav" || ext == ".w64" || ext == ".rf64" || ext == ".bw64";
+}
+
+// The decoded block cache gets a quarter of the budget, open files the rest
+Session::Session(size_t budgetBytes)
+    : budget(budgetBytes), blocks(std::make_shared<BlockCache>(budgetBytes / 4)) {}
+
+Session::~Session() {
+    if (prefetcher.joinable()) prefetcher.join();
+}
+
+bool Session::open(const std::string& path) {
+    files.clear();
+    std::error_code error;
+    if (fs::is_directory(path, error)) {
+        for (const auto& entry : fs::directory_iterator(path, error)) {
+            if (entry.is_regular_file(error) && isAudioPath(entry.path())) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else if (lowerExtension(path) == ".m3u" || lowerExtension(path) == ".txt") {
+        std::ifstream playlist(path);
+        if (!playlist) return false;
+        fs::path base = fs::path(path).parent_path();
+        std::string line;
+        while (std::getline(playlist, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty() || line[0] == '#') continue;
+            fs::path file(line);
+            files.push_back(file.is_absolute() ? line : (base / file).string());
+        }
+    } else {
+        files.push_back(path);
+    }
+    current = 0;
+    return !files.empty();
+}
+
+std::shared_ptr<AudioProcessor> Session::load(size_t index) const {
+    const std::string& path = files[index];
+    auto audio = std::make_shared<AudioProcessor>();
+    audio->shareBlockCache(blocks);
+
+    // Peaks of an earlier session, used if the file is unchanged
+    SidecarFile sidecar;
+    const SidecarFile* cache = sidecar.open(sidecarPath(path)) ? &sidecar : nullptr;
+
+    // Decoded floats take up to twice a 16-bit file, files that would not
+    // leave room for the others are mapped
+    AudioProcessor::LoadMode mode = loadMode;
+    std::error_code error;
+    uintmax_t fileBytes = fs::file_size(path, error);
+    if (mode == AudioProcessor::LoadMode::Auto && !error && fileBytes * 2 > budget / 4) {
+        mode = AudioProcessor::LoadMode::Mapped;
+    }
+    if (!audio->loadWAVAsync(path, mode, cache)) {
+        printf("Cannot read %s\n", path.c_str());
+        return nullptr;
+    }
+    return audio;
+}
+
+void Session::finishPrefetch() {
+    if (!prefetcher.joinable()) return;
+    prefetcher.join();
+    if (prefetched) {
+        // Behind the current file, ahead of everything else
+        auto pos = entries.empty() ? entries.end() : std::next(entries.begin());
+        entries.insert(pos, Entry{prefetchIndex, std::move(prefetched)});
+    }
+    prefetched.reset();
+}
+
+std::shared_ptr<AudioProcessor> Session::select(size_t index) {
+    if (index >= files.size()) return nullptr;
+    finishPrefetch();
+
+    auto it = std::find_if(entries.begin(), entries.end(), [index](const Entry& e) { return e.index == index; });
+    if (it != entries.end()) {
+        entries.splice(entries.begin(), entries, it);
+    } else {
+        std::shared_ptr<AudioProcessor> audio = load(index);
+        if (!audio) return nullptr;
+        entries.push_front(Entry{index, std::move(audio)});
+    }
+    current = index;
+    std::shared_ptr<AudioProcessor> selected = entries.front().audio;
+
+    size_t next = index + 1;
+    bool nextOpen = std::any_of(entries.begin(), entries.end(), [next](const Entry& e) { return e.index == next; });
+    if (next < files.size() && !nextOpen) {
+        prefetchIndex = next;
+        prefetcher = std::thread([this, next] {
+            profilerSetThreadName("prefetch");
+            prefetched = load(next);
+        });
+    } else if (nextOpen) {
+        auto nextEntry = std::find_if(entries.begin(), entries.end(), [next](const Entry& e) { return e.index == next; });
+        entries.splice(std::next(entries.begin()), entries, nextEntry);
+    }
+    trim();
+    return selected;
+}
+
+size_t Session::getUsedBytes() const {
+    size_t bytes = blocks->getUsedBytes();
+    for (const auto& entry : entries) bytes += entry.audio->getMemoryBytes();
+    return bytes;
+}
+
+void Session::trim() {
+    // Least recently used first, never the current file or the next one
+    size_t fileBudget = budget - blocks->getBudget();
+    size_t used = 0;
+    for (const auto& entry : entries) used += entry.audio->getMemoryBytes();
+    while (used > fileBudget && entries.size() > 2) {
+        Entry& victim = entries.back();
+        if (victim.index == current || victim.index == current + 1) break;
+        used -= victim.audio->getMemoryBytes();
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "audio_processor.h"
+#include "block_cache.h"
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Files annotated in one run: a directory, a playlist or a single WAV.
+//
+// Audio stays open after switching away. Peaks, decoded samples and the
+// shared cache of decoded blocks are kept for the most recently used files
+// within a memory budget. The file after the current one is opened on a
+// background thread ahead of time, so switching to it does not wait for its
+// header, sidecar or peaks.
+class Session {
+public:
+    static constexpr size_t kDefaultBudgetBytes = size_t(1) << 30;
+
+    explicit Session(size_t budgetBytes = kDefaultBudgetBytes);
+    // Waits for a prefetch in flight
+    ~Session();
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // A directory (its WAV files, sorted), a playlist (.m3u or .txt, one path
+    // per line relative to the playlist, # starts a comment) or one audio file
+    bool open(const std::string& path);
+    // Mode files are loaded with, by default the larger ones are mapped so
+    // a decoded file doesn't take the whole budget
+    void setLoadMode(AudioProcessor::LoadMode mode) { loadMode = mode; }
+
+    size_t size() const { return files.size(); }
+    const std::string& getFile(size_t index) const { return files[index]; }
+    size_t getCurrent() const { return current; }
+
+    // Makes index the current file and returns its audio, cached or opened
+    // now, then prefetches the next file. nullptr when it can't be read.
+    std::shared_ptr<AudioProcessor> select(size_t index);
+    // Held by the open files and the shared block cache
+    size_t getUsedBytes() const;
+    size_t getBudget() const { return budget; }
+    size_t getOpenFiles() const { return entries.size(); }
+
+private:
+    struct Entry {
+        size_t index;
+        std::shared_ptr<AudioProcessor> audio;
+    };
+
+    std::shared_ptr<AudioProcessor> load(size_t index) const;
+    void finishPrefetch();
+    void trim();
+
+    std::vector<std::string> files;
+    size_t current = 0;
+    size_t budget;
+    AudioProcessor::LoadMode loadMode = AudioProcessor::LoadMode::Auto;
+    std::shared_ptr<BlockCache> blocks;
+    // Most recently used first
+    std::list<Entry> entries;
+
+    std::thread prefetcher;
+    size_t prefetchIndex = 0;
+    std::shared_ptr<AudioProcessor> prefetched;
+};
@@ -0,0 +1,153 @@
+#include "sidecar.h"
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+static const char kMagic[8] = {'A', 'M', 'S', 'I', 'D', 'E', 'C', 'R'};
+static constexpr size_t kPayloadAlign = 64;
+
+static_assert(sizeof(SidecarFile::Header) == 80, "sidecar header layout");
+static_assert(sizeof(SidecarFile::Entry) == 32, "sidecar entry layout");
+static_assert(sizeof(SidecarFile::MarkerRecord) == 24, "sidecar marker layout");
+
+bool stampFile(const std::string& path, FileStamp& stamp) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+std::string sidecarPath(const std::string& wavFile) {
+    std::string base = wavFile;
+    size_t dotPos = base.find_last_of('.');
+    if (dotPos != std::string::npos) {
+        base = base.substr(0, dotPos);
+    }
+    return base + ".amk";
+}
+
+bool SidecarFile::open(const std::string& path) {
+    close();
+    if (!file.open(path)) return false;
+
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+    const Header* candidate = reinterpret_cast<const Header*>(data);
+    if (size < sizeof(Header) || memcmp(candidate->magic, kMagic, sizeof(kMagic)) != 0 ||
+            candidate->version != kVersion ||
+            candidate->numEntries > (size - sizeof(Header)) / sizeof(Entry)) {
+        printf("Ignoring unreadable sidecar: %s\n", path.c_str());
+        file.close();
+        return false;
+    }
+
+    // Every payload has to lie inside the file, so readers never check again
+    const Entry* table = reinterpret_cast<const Entry*>(data + sizeof(Header));
+    for (uint32_t i = 0; i < candidate->numEntries; ++i) {
+        size_t elementSize = table[i].tag == kTagMarkers ? sizeof(MarkerRecord) : sizeof(float);
+        uint64_t offset = table[i].offset;
+        if (offset % kPayloadAlign != 0 || offset > size ||
+                table[i].count > (size - offset) / elementSize) {
+            printf("Ignoring damaged sidecar: %s\n", path.c_str());
+            file.close();
+            return false;
+        }
+    }
+
+    header = candidate;
+    entries = table;
+    return true;
+}
+
+void SidecarFile::close() {
+    file.close();
+    header = nullptr;
+    entries = nullptr;
+}
+
+bool SidecarFile::write(const std::string& path, const Content& content) {
+    // Table first so the payload offsets are known
+    std::vector<Entry> table;
+    auto align = [](size_t offset) { return (offset + kPayloadAlign - 1) / kPayloadAlign * kPayloadAlign; };
+    size_t numEntries = content.arrays.size() + (content.markers ? 1 : 0);
+    size_t offset = align(sizeof(Header) + numEntries * sizeof(Entry));
+    if (content.markers) {
+        table.push_back({kTagMarkers, 0, 0, 0, offset, content.markers->size()});
+        offset = align(offset + content.markers->size() * sizeof(MarkerRecord));
+    }
+    for (const auto& array : content.arrays) {
+        table.push_back({array.tag, array.channel, array.level, array.param, offset, array.count});
+        offset = align(offset + array.count * sizeof(float));
+    }
+
+    Header head{};
+    memcpy(head.magic, kMagic, sizeof(kMagic));
+    head.version = kVersion;
+    head.numEntries = static_cast<uint32_t>(table.size());
+    head.wavSize = content.wav.size;
+    head.wavMtimeNs = content.wav.mtimeNs;
+    head.numSamples = content.numSamples;
+    head.sampleRate = static_cast<uint32_t>(content.sampleRate);
+    head.numChannels = static_cast<uint32_t>(content.numChannels);
+    if (content.markers) {
+        head.csvSize = content.csv.size;
+        head.csvMtimeNs = content.csv.mtimeNs;
+        head.csvHash = content.csvHash;
+    }
+
+    std::string data(offset, '\0');
+    memcpy(&data[0], &head, sizeof(head));
+    memcpy(&data[sizeof(Header)], table.data(), table.size() * sizeof(Entry));
+    size_t next = 0;
+    if (content.markers) {
+        MarkerRecord* records = reinterpret_cast<MarkerRecord*>(&data[table[next++].offset]);
+        for (const Marker& m : *content.markers) {
+            *records++ = {m.sample, m.end, m.intensity, 0};
+        }
+    }
+    for (const auto& array : content.arrays) {
+        memcpy(&data[table[next++].offset], array.data, array.count * sizeof(float));
+    }
+    return writeFileAtomic(path, data);
+}
+
+bool SidecarFile::matchesWav(const std::string& wavPath) const {
+    FileStamp stamp;
+    return isOpen() && stampFile(wavPath, stamp) &&
+        stamp == FileStamp{header->wavSize, header->wavMtimeNs};
+}
+
+bool SidecarFile::matchesCsv(const std::string& csvPath) const {
+    FileStamp stamp;
+    return isOpen() && hasMarkers() && stampFile(csvPath, stamp) &&
+        stamp == FileStamp{header->csvSize, header->csvMtimeNs};
+}
+
+void SidecarFile::readMarkers(std::vector<Marker>& out) const {
+    const Entry* entry = findEntry(kTagMarkers, 0, 0);
+    if (!entry) return;
+    const MarkerRecord* records = reinterpret_cast<const MarkerRecord*>(file.data() + entry->offset);
+    out.reserve(out.size() + entry->count);
+    for (size_t i = 0; i < entry->count; ++i) {
+        out.push_back({records[i].sample, records[i].intensity, records[i].end});
+    }
+}
+
+const float* SidecarFile::findArray(uint32_t tag, size_t channel, size_t level, uint64_t& param, size_t& count) const {
+    const Entry* entry = findEntry(tag, channel, level);
+    if (!entry || tag == kTagMarkers) return nullptr;
+    param = entry->param;
+    count = entry->count;
+    return reinterpret_cast<const float*>(file.data() + entry->offset);
+}
+
+const SidecarFile::Entry* SidecarFile::findEntry(uint32_t tag, size_t channel, size_t level) const {
+    if (!isOpen()) return nullptr;
+    for (uint32_t i = 0; i < header->numEntries; ++i) {
+        if (entries[i].tag == tag && entries[i].channel == channel && entries[i].level == level) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "markers.h"
+#include "mapped_file.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Binary companion of a WAV file and its markers CSV: the markers, the peak
+// pyramid and analysis envelopes in one versioned file, read by mapping it.
+//
+// Layout, little-endian: a fixed Header, numEntries Entry records, then one
+// 64-byte aligned payload per entry. Markers are stored sorted as fixed-size
+// records, float arrays as raw floats, so nothing is parsed on open.
+//
+// The CSV stays the source of truth. The sidecar records the size and mtime
+// of the WAV and CSV it was written from and each part is only used while
+// its file is unchanged.
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && mtimeNs == other.mtimeNs;
+    }
+};
+
+bool stampFile(const std::string& path, FileStamp& stamp);
+
+// Sidecar next to the WAV file, same base name
+std::string sidecarPath(const std::string& wavFile);
+
+class SidecarFile {
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kTagMarkers = 0x4b52414d;  // "MARK"
+    static constexpr uint32_t kTagPeaks = 0x4b414550;    // "PEAK", per channel and level
+    static constexpr uint32_t kTagRms = 0x20534d52;      // "RMS ", onset detector envelope
+    static constexpr uint32_t kTagFlux = 0x58554c46;     // "FLUX", onset detector envelope
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t numEntries;
+        uint64_t wavSize;
+        int64_t wavMtimeNs;
+        uint64_t numSamples;
+        uint32_t sampleRate;
+        uint32_t numChannels;
+        uint64_t csvSize;   // 0 with csvMtimeNs 0: no markers section
+        int64_t csvMtimeNs;
+        uint64_t csvHash;   // hashBytes() of the CSV, ties the journal to it
+        uint64_t reserved;
+    };
+
+    struct Entry {
+        uint32_t tag;
+        uint16_t channel;
+        uint16_t level;
+        uint64_t param;  // samples per bucket or per hop
+        uint64_t offset; // from the start of the file
+        uint64_t count;  // records or floats
+    };
+
+    struct MarkerRecord {
+        uint64_t sample;
+        uint64_t end;
+        int32_t intensity;
+        uint32_t reserved;
+    };
+#pragma pack(pop)
+
+    // One float payload of a sidecar being written
+    struct FloatArray {
+        uint32_t tag;
+        uint16_t channel;
+        uint16_t level;
+        uint64_t param;
+        const float* data;
+        size_t count;
+    };
+
+    // Everything a session writes out. markers may be null, then the
+    // sidecar has no markers section.
+    struct Content {
+        FileStamp wav;
+        size_t numSamples = 0;
+        size_t sampleRate = 0;
+        size_t numChannels = 0;
+        FileStamp csv;
+        uint64_t csvHash = 0;
+        const std::vector<Marker>* markers = nullptr;
+        std::vector<FloatArray> arrays;
+    };
+
+    SidecarFile() = default;
+    SidecarFile(const SidecarFile&) = delete;
+    SidecarFile& operator=(const SidecarFile&) = delete;
+
+    // Maps and validates the file, false if it is missing, of another
+    // version or damaged
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    static bool write(const std::string& path, const Content& content);
+
+    // The WAV or CSV at path is the one this sidecar was written from
+    bool matchesWav(const std::string& wavPath) const;
+    bool matchesCsv(const std::string& csvPath) const;
+
+    size_t getNumSamples() const { return header->numSamples; }
+    size_t getSampleRate() const { return header->sampleRate; }
+    size_t getNumChannels() const { return header->numChannels; }
+    uint64_t getCsvHash() const { return header->csvHash; }
+
+    bool hasMarkers() const { return findEntry(kTagMarkers, 0, 0) != nullptr; }
+    // Appends the markers, in CSV order
+    void readMarkers(std::vector<Marker>& out) const;
+    // Floats of an array, nullptr when there is none
+    const float* findArray(uint32_t tag, size_t channel, size_t level, uint64_t& param, size_t& count) const;
+
+private:
+    const Entry* findEntry(uint32_t tag, size_t channel, size_t level) const;
+
+    MappedFile file;
+    const Header* header = nullptr;
+    const Entry* entries = nullptr;
+};
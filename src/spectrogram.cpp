@@ -0,0 +1,224 @@
+#include "spectrogram.h"
+#include "fft.h"
+#include "profiler.h"
+#include "implot.h"
+#include <algorithm>
+#include <cmath>
+
+// Dark blue to yellow, five stops interpolated linearly
+static uint32_t colormap(float t) {
+    static const float stops[5][3] = {
+        {0.0f, 0.0f, 0.1f}, {0.25f, 0.0f, 0.45f}, {0.75f, 0.1f, 0.35f}, {1.0f, 0.55f, 0.0f}, {1.0f, 1.0f, 0.6f}
+    };
+    t = std::min(std::max(t, 0.0f), 1.0f) * 4.0f;
+    int i = std::min(static_cast<int>(t), 3);
+    float f = t - i;
+    uint32_t rgba = 0xFF000000u;
+    for (int c = 0; c < 3; ++c) {
+        float v = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f;
+        rgba |= static_cast<uint32_t>(v * 255.0f + 0.5f) << (8 * c);
+    }
+    return rgba;
+}
+
+Spectrogram::~Spectrogram() {
+    tasks.wait();
+}
+
+void Spectrogram::clear() {
+    tasks.wait();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : tiles) {
+        if (entry.second.texture != 0) glDeleteTextures(1, &entry.second.texture);
+    }
+    tiles.clear();
+    textureBytes = 0;
+}
+
+bool Spectrogram::isBusy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (inFlight > 0) return true;
+    for (const auto& entry : tiles) {
+        if (entry.second.state == TileState::Ready) return true;
+    }
+    return false;
+}
+
+void Spectrogram::invalidateFrom(size_t sample) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        int level = static_cast<int>(it->first >> 48);
+        size_t index = static_cast<size_t>(it->first & ((uint64_t(1) << 48) - 1));
+        if ((index + 1) * tileSamples(level) + kFFTSize <= sample) {
+            ++it;
+        } else if (it->second.state == TileState::Computing) {
+            it->second.stale = true;
+            ++it;
+        } else {
+            if (it->second.texture != 0) {
+                glDeleteTextures(1, &it->second.texture);
+                textureBytes -= kTileColumns * kBins * 4;
+            }
+            it = tiles.erase(it);
+        }
+    }
+}
+
+bool Spectrogram::tileComputable(int level, size_t index) const {
+    size_t numSamples = audio.getNumSamples();
+    size_t start = index * tileSamples(level);
+    if (start >= numSamples) return false;
+    // Tiles still being loaded are computed once the loader has passed them
+    size_t end = std::min(start + tileSamples(level) + kFFTSize, numSamples);
+    return audio.getLoadedSamples() >= end;
+}
+
+void Spectrogram::computeTile(int level, size_t index) {
+    PROFILE_SCOPE("spectrogram tile");
+    FFT fft(kFFTSize);
+    std::vector<float> mix(kFFTSize), channel(kFFTSize), bins(kBins);
+    std::vector<uint32_t> pixels(kTileColumns * kBins);
+    size_t numChannels = audio.getNumChannels();
+    size_t numSamples = audio.getNumSamples();
+    size_t step = hop(level);
+
+    for (size_t column = 0; column < kTileColumns; ++column) {
+        // Window centered on the column, zero padded at the file edges
+        size_t center = index * tileSamples(level) + column * step + step / 2;
+        size_t start = center >= kFFTSize / 2 ? center - kFFTSize / 2 : 0;
+        size_t offset = start + kFFTSize / 2 - center;
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        if (start < numSamples) {
+            size_t count = std::min(kFFTSize - offset, numSamples - start);
+            for (size_t c = 0; c < numChannels; ++c) {
+                size_t read = audio.readSamples(c, start, count, channel.data());
+                for (size_t i = 0; i < read; ++i) mix[offset + i] += channel[i] / numChannels;
+            }
+        }
+        fft.spectrumDb(mix.data(), bins.data(), kMinDb);
+        for (size_t bin = 0; bin < kBins; ++bin) {
+            float t = (bins[bin] - kMinDb) / (kMaxDb - kMinDb);
+            pixels[(kBins - 1 - bin) * kTileColumns + column] = colormap(t);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    inFlight--;
+    auto it = tiles.find(tileKey(level, index));
+    // Dropped by clear() in the meantime
+    if (it == tiles.end()) return;
+    if (it->second.stale) {
+        tiles.erase(it);
+        return;
+    }
+    it->second.pixels = std::move(pixels);
+    it->second.state = TileState::Ready;
+}
+
+void Spectrogram::upload(Tile& tile) {
+    glGenTextures(1, &tile.texture);
+    glBindTexture(GL_TEXTURE_2D, tile.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kTileColumns, kBins, 0, GL_RGBA, GL_UNSIGNED_BYTE, tile.pixels.data());
+    tile.pixels = std::vector<uint32_t>();
+    tile.state = TileState::Uploaded;
+    textureBytes += kTileColumns * kBins * 4;
+}
+
+void Spectrogram::evictTextures() {
+    // Finished tiles that scrolled out before their upload are dropped
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        if (it->second.state == TileState::Ready && it->second.lastUsed != frame) {
+            it = tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Least recently drawn first, never what this frame drew
+    while (textureBytes > kTextureBudgetBytes) {
+        auto victim = tiles.end();
+        for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+            if (it->second.state != TileState::Uploaded || it->second.lastUsed == frame) continue;
+            if (victim == tiles.end() || it->second.lastUsed < victim->second.lastUsed) victim = it;
+        }
+        if (victim == tiles.end()) break;
+        glDeleteTextures(1, &victim->second.texture);
+        textureBytes -= kTileColumns * kBins * 4;
+        tiles.erase(victim);
+    }
+}
+
+void Spectrogram::draw(double xMin, double xMax, float plotWidth) {
+    size_t numSamples = audio.getNumSamples();
+    if (numSamples == 0 || xMax <= xMin) return;
+    frame++;
+    xMin = std::max(xMin, 0.0);
+    xMax = std::min(xMax, static_cast<double>(numSamples));
+    if (xMax <= xMin) return;
+
+    // About one column per pixel
+    double samplesPerPixel = (xMax - xMin) / std::max(plotWidth, 1.0f);
+    int level = 0;
+    while (level + 1 < kNumLevels && static_cast<double>(hop(level)) < samplesPerPixel) level++;
+
+    size_t first = static_cast<size_t>(xMin) / tileSamples(level);
+    size_t last = static_cast<size_t>(xMax - 1) / tileSamples(level);
+    // Nearest to the center of the view first
+    std::vector<size_t> wanted;
+    for (size_t i = first; i <= last; ++i) wanted.push_back(i);
+    double center = (first + last) / 2.0;
+    std::stable_sort(wanted.begin(), wanted.end(),
+        [center](size_t a, size_t b) { return std::abs(a - center) < std::abs(b - center); });
+
+    // What to draw: each visible tile, or the first coarser one that has a texture
+    std::vector<std::pair<int, size_t>> drawList;
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t uploads = 0;
+    for (size_t index : wanted) {
+        auto it = tiles.find(tileKey(level, index));
+        if (it != tiles.end()) it->second.lastUsed = frame;
+        if (it == tiles.end() && inFlight < tasks.getPool().size() && tileComputable(level, index)) {
+            Tile& tile = tiles[tileKey(level, index)];
+            tile.lastUsed = frame;
+            inFlight++;
+            tasks.submit([this, level, index] { computeTile(level, index); });
+            it = tiles.find(tileKey(level, index));
+        }
+        if (it != tiles.end() && it->second.state == TileState::Ready && uploads < kUploadsPerFrame) {
+            upload(it->second);
+            uploads++;
+        }
+        if (it != tiles.end() && it->second.state == TileState::Uploaded) {
+            drawList.emplace_back(level, index);
+            continue;
+        }
+        for (int coarser = level + 1; coarser < kNumLevels; ++coarser) {
+            size_t coarseIndex = index * tileSamples(level) / tileSamples(coarser);
+            auto fallback = tiles.find(tileKey(coarser, coarseIndex));
+            if (fallback != tiles.end() && fallback->second.state == TileState::Uploaded) {
+                drawList.emplace_back(coarser, coarseIndex);
+                break;
+            }
+        }
+    }
+
+    // Coarse stand-ins go below the exact tiles
+    std::sort(drawList.begin(), drawList.end(), [](const std::pair<int, size_t>& a, const std::pair<int, size_t>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    drawList.erase(std::unique(drawList.begin(), drawList.end()), drawList.end());
+    double nyquist = audio.getSampleRate() / 2.0;
+    for (const auto& item : drawList) {
+        Tile& tile = tiles[tileKey(item.first, item.second)];
+        tile.lastUsed = frame;
+        double start = static_cast<double>(item.second * tileSamples(item.first));
+        double end = start + tileSamples(item.first);
+        ImPlot::PlotImage("##spectrogram", (ImTextureID)(intptr_t)tile.texture,
+            ImPlotPoint(start, 0.0), ImPlotPoint(end, nyquist));
+    }
+    evictTextures();
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "audio_processor.h"
+#include "thread_pool.h"
+#include <GL/gl3w.h>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// Spectrogram of the channel mixdown, computed in fixed-size time tiles.
+//
+// Level l puts kBaseHop << l samples between columns, each tile holds
+// kTileColumns columns of kFFTSize / 2 bins. Tiles are computed on worker
+// threads, visible ones only and nearest to the view center first, then
+// uploaded as textures and kept in an LRU bounded by kTextureBudgetBytes.
+// While a tile is missing the covering tile of a coarser level stands in.
+class Spectrogram {
+public:
+    static constexpr size_t kFFTSize = 1024;
+    static constexpr size_t kBins = kFFTSize / 2;
+    static constexpr size_t kTileColumns = 256;
+    static constexpr size_t kBaseHop = 64;
+    static constexpr int kNumLevels = 20;
+    static constexpr size_t kTextureBudgetBytes = size_t(64) << 20;
+    // Uploads are spread over frames to avoid hitches
+    static constexpr size_t kUploadsPerFrame = 4;
+    static constexpr float kMinDb = -100.0f;
+    static constexpr float kMaxDb = 0.0f;
+
+    // Tiles are computed on pool, which is shared with the other analyses
+    Spectrogram(const AudioProcessor& audio, ThreadPool& pool) : audio(audio), tasks(pool) {}
+    // Waits for running tiles, textures must be gone through clear() by then
+    ~Spectrogram();
+    Spectrogram(const Spectrogram&) = delete;
+    Spectrogram& operator=(const Spectrogram&) = delete;
+
+    // Drops every tile and texture, call with the GL context current
+    void clear();
+    // Draws [xMin, xMax] into the current ImPlot plot, plotWidth pixels
+    // wide, and schedules the tiles it is missing. UI thread only.
+    void draw(double xMin, double xMax, float plotWidth);
+    // Tiles are being computed or wait for an upload
+    bool isBusy() const;
+    // Drops the tiles whose windows reach sample or beyond, after a tailed
+    // file grew there. UI thread only.
+    void invalidateFrom(size_t sample);
+
+private:
+    enum class TileState { Computing, Ready, Uploaded };
+
+    struct Tile {
+        TileState state = TileState::Computing;
+        std::vector<uint32_t> pixels; // RGBA, kBins rows of kTileColumns, top row is Nyquist
+        GLuint texture = 0;
+        uint64_t lastUsed = 0;
+        // Invalidated while computing, dropped once done
+        bool stale = false;
+    };
+
+    static uint64_t tileKey(int level, size_t index) { return (uint64_t(level) << 48) | index; }
+    static size_t hop(int level) { return kBaseHop << level; }
+    static size_t tileSamples(int level) { return kTileColumns * hop(level); }
+
+    void computeTile(int level, size_t index);
+    bool tileComputable(int level, size_t index) const;
+    void upload(Tile& tile);
+    void evictTextures();
+
+    const AudioProcessor& audio;
+    TaskGroup tasks;
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Tile> tiles;
+    size_t inFlight = 0;
+    size_t textureBytes = 0;
+    uint64_t frame = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Fixed-size single-producer/single-consumer ring of T slots. Slots are
+// filled and drained in place, no call allocates, locks or blocks, so the
+// consumer side is safe to use from a real-time audio callback.
+template <typename T>
+class SpscRing {
+public:
+    // capacity is rounded up to a power of two, all slots are allocated here
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+    // Approximate from any thread, exact from either end
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Producer: next free slot or nullptr when full, publish it with commitWrite()
+    T* beginWrite() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) > mask) return nullptr;
+        return &slots[h & mask];
+    }
+    void commitWrite() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest filled slot or nullptr when empty, free it with commitRead()
+    const T* beginRead() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return nullptr;
+        return &slots[t & mask];
+    }
+    void commitRead() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    // Each index is written by one side only, kept on separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
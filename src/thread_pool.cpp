@@ -0,0 +1,134 @@
+#include "thread_pool.h"
+#include "profiler.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+size_t ThreadPool::backgroundThreads() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 2 ? cores - 1 : 1;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::workerLoop() {
+    profilerSetThreadName("pool worker");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) return;
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        running++;
+        lock.unlock();
+        task();
+        lock.lock();
+        running--;
+        if (tasks.empty() && running == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+void TaskGroup::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+    }
+    pool.submit([this, task = std::move(task)] {
+        task();
+        // Notified under the lock, a waiter may destroy the group right after
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) done.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+bool ChunkedJob::begin(size_t count, std::function<void(size_t)> chunk, std::function<void()> finish) {
+    if (isRunning()) return false;
+    // The previous pass's last task may still be returning
+    tasks.wait();
+    chunkFn = std::move(chunk);
+    finishFn = std::move(finish);
+    numChunks = count;
+    cancelled = false;
+    chunksDone = 0;
+    running.store(true, std::memory_order_release);
+    if (count == 0) {
+        finishFn();
+        running.store(false, std::memory_order_release);
+    }
+    return true;
+}
+
+bool ChunkedJob::start(size_t count, std::function<void(size_t)> chunk, std::function<void()> finish) {
+    if (!begin(count, std::move(chunk), std::move(finish))) return false;
+    for (size_t i = 0; i < count; ++i) {
+        tasks.submit([this, i] {
+            chunkFn(i);
+            chunkDone();
+        });
+    }
+    return true;
+}
+
+bool ChunkedJob::run(size_t count, std::function<void(size_t)> chunk, std::function<void()> finish) {
+    if (!begin(count, std::move(chunk), std::move(finish))) return false;
+    for (size_t i = 0; i < count; ++i) {
+        chunkFn(i);
+        chunkDone();
+    }
+    return true;
+}
+
+void ChunkedJob::chunkDone() {
+    if (chunksDone.fetch_add(1, std::memory_order_acq_rel) + 1 != numChunks) return;
+    if (!isCancelled()) finishFn();
+    running.store(false, std::memory_order_release);
+}
+
+void ChunkedJob::cancel() {
+    cancelled = true;
+    tasks.wait();
+    running.store(false, std::memory_order_release);
+}
+
+float ChunkedJob::getProgress() const {
+    if (numChunks == 0) return 1.0f;
+    return static_cast<float>(chunksDone.load(std::memory_order_relaxed)) / numChunks;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Fixed set of worker threads draining a FIFO of tasks
+class ThreadPool {
+public:
+    // 0 picks one thread per hardware thread
+    explicit ThreadPool(size_t numThreads = 0);
+    // Size of a pool working next to the UI, one core is left to the UI
+    // and the audio feeder
+    static size_t backgroundThreads();
+    // Runs what is still queued, then joins the workers
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until the queue is empty and no task is running
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable idle;
+    size_t running = 0;
+    bool stopping = false;
+};
+
+// The tasks of one user of a shared pool, waited for on their own so other
+// users' work doesn't hold up a wait()
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+    ~TaskGroup() { wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every task submitted through the group has run
+    void wait();
+
+    ThreadPool& getPool() const { return pool; }
+
+private:
+    ThreadPool& pool;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending = 0;
+};
+
+// A background pass split into independent chunks: chunks run on the pool
+// in any order and the last one to finish calls finish(), unless the pass
+// was cancelled. The UI polls isRunning() and getProgress().
+class ChunkedJob {
+public:
+    explicit ChunkedJob(ThreadPool& pool) : tasks(pool) {}
+    ~ChunkedJob() { cancel(); }
+    ChunkedJob(const ChunkedJob&) = delete;
+    ChunkedJob& operator=(const ChunkedJob&) = delete;
+
+    // Submits chunk(0) to chunk(numChunks - 1), false if a pass is running
+    bool start(size_t numChunks, std::function<void(size_t)> chunk, std::function<void()> finish);
+    // Same pass on the calling thread
+    bool run(size_t numChunks, std::function<void(size_t)> chunk, std::function<void()> finish);
+    // Stops a running pass and waits for its chunks, which should check
+    // isCancelled() and return early
+    void cancel();
+
+    bool isRunning() const { return running.load(std::memory_order_acquire); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    float getProgress() const;
+    ThreadPool& getPool() const { return tasks.getPool(); }
+
+private:
+    bool begin(size_t numChunks, std::function<void(size_t)> chunk, std::function<void()> finish);
+    void chunkDone();
+
+    TaskGroup tasks;
+    std::function<void(size_t)> chunkFn;
+    std::function<void()> finishFn;
+    size_t numChunks = 0;
+    std::atomic<bool> running{false};
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> chunksDone{0};
+};
@@ -0,0 +1,44 @@
+#include "wav_writer.h"
+#include <cstdio>
+#include <cstring>
+
+static void putU16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+static void putU32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+
+bool writeWAVHeader(FILE* out, SampleFormat format, size_t numChannels, size_t sampleRate, size_t numFrames) {
+    size_t sampleBytes = bytesPerSample(format);
+    size_t dataBytes = numFrames * numChannels * sampleBytes;
+    if (numChannels == 0 || numChannels > 0xFFFF || dataBytes > 0xFFFFFFFFull - 36) {
+        return false;
+    }
+    bool isFloat = format == SampleFormat::Float32 || format == SampleFormat::Float64;
+
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    putU32(header + 4, static_cast<uint32_t>(36 + dataBytes + (dataBytes & 1)));
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putU32(header + 16, 16);
+    putU16(header + 20, isFloat ? 3 : 1);
+    putU16(header + 22, static_cast<uint16_t>(numChannels));
+    putU32(header + 24, static_cast<uint32_t>(sampleRate));
+    putU32(header + 28, static_cast<uint32_t>(sampleRate * numChannels * sampleBytes));
+    putU16(header + 32, static_cast<uint16_t>(numChannels * sampleBytes));
+    putU16(header + 34, static_cast<uint16_t>(sampleBytes * 8));
+    memcpy(header + 36, "data", 4);
+    putU32(header + 40, static_cast<uint32_t>(dataBytes));
+    return fwrite(header, 1, sizeof(header), out) == sizeof(header);
+}
+
+bool writeWAV(const std::string& path, SampleFormat format, size_t numChannels, size_t sampleRate,
+              const uint8_t* frames, size_t numFrames) {
+    size_t dataBytes = numFrames * numChannels * bytesPerSample(format);
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool ok = writeWAVHeader(out, format, numChannels, sampleRate, numFrames) &&
+              fwrite(frames, 1, dataBytes, out) == dataBytes;
+    // Chunks are padded to an even size
+    if (ok && (dataBytes & 1)) ok = fputc(0, out) != EOF;
+    ok = fclose(out) == 0 && ok;
+    if (!ok) remove(path.c_str());
+    return ok;
+}
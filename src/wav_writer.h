@@ -0,0 +1,15 @@
+#pragma once
+#include "pcm_decode.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Writes interleaved frames, already encoded in format, as a canonical
+// 44-byte-header WAV file. Fails for data that does not fit a RIFF chunk.
+bool writeWAV(const std::string& path, SampleFormat format, size_t numChannels, size_t sampleRate,
+              const uint8_t* frames, size_t numFrames);
+
+// Writes the 44-byte header for numFrames frames, the caller appends the
+// encoded frames and the pad byte of an odd-sized data chunk
+bool writeWAVHeader(FILE* out, SampleFormat format, size_t numChannels, size_t sampleRate, size_t numFrames);
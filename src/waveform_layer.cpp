@@ -0,0 +1,138 @@
+#include "waveform_layer.h"
+#include "waveform_plot.h"
+#include "profiler.h"
+#include "implot.h"
+#include "imgui_impl_opengl3.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+WaveformLayer::~WaveformLayer() {
+    delete drawList;
+}
+
+void WaveformLayer::clear() {
+    if (framebuffer != 0) glDeleteFramebuffers(1, &framebuffer);
+    if (texture != 0) glDeleteTextures(1, &texture);
+    framebuffer = 0;
+    texture = 0;
+    textureWidth = 0;
+    textureHeight = 0;
+    valid = false;
+}
+
+bool WaveformLayer::ensureTarget(int width, int height) {
+    if (unsupported) return false;
+    if (texture != 0 && width == textureWidth && height == textureHeight) return true;
+    clear();
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (!complete) {
+        printf("Waveform framebuffer unavailable, drawing lines directly\n");
+        clear();
+        unsupported = true;
+        return false;
+    }
+    textureWidth = width;
+    textureHeight = height;
+    return true;
+}
+
+void WaveformLayer::renderToTexture(const View& view) {
+    // Same polyline the plot would draw: raw samples, or each bucket's min
+    // and max at the bucket's X so they form a vertical stroke
+    if (!drawList) drawList = new ImDrawList(ImGui::GetDrawListSharedData());
+    drawList->_ResetForNewFrame();
+    drawList->Flags = ImDrawListFlags_AntiAliasedLines | ImDrawListFlags_AntiAliasedLinesUseTex;
+    drawList->PushTextureID(ImGui::GetIO().Fonts->TexID);
+    drawList->PushClipRect(ImVec2(0, 0), ImVec2((float)view.width, (float)view.height));
+
+    float scale = ImGui::GetIO().DisplayFramebufferScale.x;
+    double xScale = view.width / (view.xMax - view.xMin);
+    double yScale = view.height / (view.yMax - view.yMin);
+    size_t count = waveform.values.size();
+    points.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t sample = waveform.samplesPerBucket == 1
+            ? waveform.firstSample + i
+            : waveform.firstSample + (i / 2) * waveform.samplesPerBucket;
+        points[i] = ImVec2(static_cast<float>((sample - view.xMin) * xScale),
+                           static_cast<float>((view.yMax - waveform.values[i]) * yScale));
+    }
+    if (count >= 2) {
+        drawList->AddPolyline(points.data(), (int)count, view.color, ImDrawFlags_None, scale);
+    }
+
+    ImDrawData drawData;
+    drawData.Valid = true;
+    drawData.CmdLists.push_back(drawList);
+    drawData.CmdListsCount = 1;
+    drawData.TotalVtxCount = drawList->VtxBuffer.Size;
+    drawData.TotalIdxCount = drawList->IdxBuffer.Size;
+    drawData.DisplayPos = ImVec2(0, 0);
+    drawData.DisplaySize = ImVec2((float)view.width, (float)view.height);
+    drawData.FramebufferScale = ImVec2(1.0f, 1.0f);
+
+    // The backend restores its GL state but not the framebuffer
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, view.width, view.height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    ImGui_ImplOpenGL3_RenderDrawData(&drawData);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+void WaveformLayer::draw(const AudioProcessor& audio, size_t channel, const ImVec4& color) {
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    ImVec2 size = ImPlot::GetPlotSize();
+    ImVec2 framebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+
+    // Texture pixels match framebuffer pixels so the image is not resampled
+    View view;
+    view.xMin = limits.X.Min;
+    view.xMax = limits.X.Max;
+    view.yMin = limits.Y.Min;
+    view.yMax = limits.Y.Max;
+    view.width = std::max(1, (int)std::lround(size.x * framebufferScale.x));
+    view.height = std::max(1, (int)std::lround(size.y * framebufferScale.y));
+    view.loadedSamples = audio.getLoadedSamples();
+    view.color = ImGui::GetColorU32(color);
+
+    bool cachedView = valid && view == cached;
+    if (!cachedView) {
+        PROFILE_SCOPE("waveform getter");
+        downsampleForPlot(audio, channel, waveform);
+    }
+
+    if (ensureTarget(view.width, view.height)) {
+        if (!cachedView) {
+            PROFILE_SCOPE("waveform line");
+            renderToTexture(view);
+            cached = view;
+            valid = true;
+        }
+        ImPlot::PlotImage("Waveform", (ImTextureID)(intptr_t)texture,
+            ImPlotPoint(view.xMin, view.yMin), ImPlotPoint(view.xMax, view.yMax));
+        return;
+    }
+
+    PROFILE_SCOPE("waveform line");
+    plotWaveformLine(waveform, color);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "audio_processor.h"
+#include "imgui.h"
+#include <GL/gl3w.h>
+#include <cstddef>
+#include <vector>
+
+// One channel's waveform line, rendered into a texture and drawn into the
+// plot as an image. While the view, plot size and loaded range stay the
+// same, e.g. while hovering or editing markers, a frame costs one textured
+// quad instead of downsampling and tessellating the line again.
+//
+// Falls back to plotting the line directly when no framebuffer can be made.
+class WaveformLayer {
+public:
+    WaveformLayer() = default;
+    // Textures must be gone through clear() by then
+    ~WaveformLayer();
+    WaveformLayer(const WaveformLayer&) = delete;
+    WaveformLayer& operator=(const WaveformLayer&) = delete;
+
+    // Drops the framebuffer and texture, call with the GL context current
+    void clear();
+    // Draws the channel into the current ImPlot plot, UI thread only
+    void draw(const AudioProcessor& audio, size_t channel, const ImVec4& color);
+
+private:
+    struct View {
+        double xMin = 0.0, xMax = 0.0, yMin = 0.0, yMax = 0.0;
+        int width = 0, height = 0;
+        size_t loadedSamples = 0;
+        ImU32 color = 0;
+
+        bool operator==(const View& other) const {
+            return xMin == other.xMin && xMax == other.xMax && yMin == other.yMin && yMax == other.yMax &&
+                width == other.width && height == other.height &&
+                loadedSamples == other.loadedSamples && color == other.color;
+        }
+    };
+
+    bool ensureTarget(int width, int height);
+    void renderToTexture(const View& view);
+
+    AudioProcessor::WaveformData waveform;
+    std::vector<ImVec2> points;
+    ImDrawList* drawList = nullptr;
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    int textureWidth = 0;
+    int textureHeight = 0;
+    bool unsupported = false;
+    bool valid = false;
+    View cached;
+};
@@ -0,0 +1,85 @@
+#include "waveform_plot.h"
+#include "implot.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <vector>
+
+const ImVec4 kIntensityColors[MarkerBatch::kNumIntensities] = {
+    ImVec4(0.4f, 0.8f, 0.4f, 1.0f),   // blue for Low
+    ImVec4(1.0f, 1.0f, 0.0f, 1.0f),   // Yellow for Med
+    ImVec4(1.0f, 0.5f, 0.0f, 1.0f),   // Orange for High
+    ImVec4(1.0f, 0.0f, 0.0f, 1.0f)    // Red for Very High
+};
+
+void downsampleForPlot(const AudioProcessor& audio, size_t channel, AudioProcessor::WaveformData& waveform) {
+    ImPlotRect limits = ImPlot::GetPlotLimits();
+    size_t minX = static_cast<size_t>(std::max(limits.X.Min, 0.0));
+    size_t maxX = static_cast<size_t>(std::max(std::ceil(limits.X.Max), 0.0)) + 1;
+    size_t maxPoints = static_cast<size_t>(ImPlot::GetPlotSize().x) * 2;
+    audio.getDownsampledData(channel, minX, maxX, maxPoints, waveform);
+}
+
+void plotWaveformLine(const AudioProcessor::WaveformData& waveform, const ImVec4& color) {
+    auto getter = [](int idx, void* data) -> ImPlotPoint {
+        auto* waveform = (const AudioProcessor::WaveformData*)(data);
+        float y = waveform->values[idx];
+        if (waveform->samplesPerBucket == 1) {
+            return ImPlotPoint(waveform->firstSample + idx, y);
+        }
+        // min and max of a bucket share its X so they draw as a vertical stroke
+        return ImPlotPoint(waveform->firstSample + (idx / 2) * waveform->samplesPerBucket, y);
+    };
+    ImPlot::PushStyleColor(ImPlotCol_Line, color);
+    ImPlot::PlotLineG("Waveform", getter, const_cast<AudioProcessor::WaveformData*>(&waveform),
+        (int)waveform.values.size(), 0.0);
+    ImPlot::PopStyleColor();
+}
+
+void renderMarkerBatch(const MarkerBatch& batch, double samplesPerPixel, bool suggested) {
+    ImDrawList* drawList = ImPlot::GetPlotDrawList();
+    float top = ImPlot::GetPlotPos().y;
+    float bottom = top + ImPlot::GetPlotSize().y;
+
+    ImPlot::PushPlotClipRect();
+    ImU32 sectionColor = ImGui::GetColorU32(ImVec4(1.0f, 0.0f, 0.0f, 0.125f));
+    for (size_t i = 0; i + 1 < batch.spans.size(); i += 2) {
+        float x0 = ImPlot::PlotToPixels(batch.spans[i], 0.0).x;
+        float x1 = ImPlot::PlotToPixels(batch.spans[i + 1], 0.0).x;
+        drawList->AddRectFilled(ImVec2(x0, top), ImVec2(std::max(x1, x0 + 1.0f), bottom), sectionColor);
+    }
+    ImPlot::PopPlotClipRect();
+
+    for (int level = 0; level < MarkerBatch::kNumIntensities; ++level) {
+        const std::vector<double>& lines = batch.lines[level];
+        if (lines.empty()) continue;
+        ImVec4 color = kIntensityColors[level];
+        if (suggested) color.w = 0.35f;
+        ImPlot::PushStyleColor(ImPlotCol_Line, color);
+        ImPlot::PlotInfLines(suggested ? "suggested" : "audio marks", lines.data(), (int)lines.size());
+        ImPlot::PopStyleColor();
+    }
+
+    if (suggested || samplesPerPixel <= 1.0) return;
+    // One badge row per intensity, a badge is skipped when it would
+    // overlap the previous one in its row
+    ImPlot::PushPlotClipRect();
+    float rowHeight = ImGui::GetTextLineHeight();
+    for (int level = 0; level < MarkerBatch::kNumIntensities; ++level) {
+        const std::vector<double>& lines = batch.lines[level];
+        const std::vector<uint32_t>& counts = batch.counts[level];
+        ImU32 badgeColor = ImGui::GetColorU32(kIntensityColors[level]);
+        float nextFree = -FLT_MAX;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (counts[i] < 2) continue;
+            float x = ImPlot::PlotToPixels(lines[i], 0.0).x + 2.0f;
+            if (x < nextFree) continue;
+            char badge[16];
+            int len = snprintf(badge, sizeof(badge), "%u", counts[i]);
+            drawList->AddText(ImVec2(x, top + 2.0f + level * rowHeight), badgeColor, badge, badge + len);
+            nextFree = x + ImGui::CalcTextSize(badge, badge + len).x + 4.0f;
+        }
+    }
+    ImPlot::PopPlotClipRect();
+}
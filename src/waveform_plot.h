@@ -0,0 +1,22 @@
+#pragma once
+#include "audio_processor.h"
+#include "marker_batch.h"
+#include "imgui.h"
+#include <cstddef>
+
+// Drawing into the current ImPlot plot shared by the viewer's waveform plots
+// and the benchmarks, so both submit the same items
+
+// Marker colors by intensity, Low to Very High
+extern const ImVec4 kIntensityColors[MarkerBatch::kNumIntensities];
+
+// The channel over the plot's X range, about 2 points per horizontal pixel
+// whatever the zoom level
+void downsampleForPlot(const AudioProcessor& audio, size_t channel, AudioProcessor::WaveformData& waveform);
+// Plots downsampled data as one line item
+void plotWaveformLine(const AudioProcessor::WaveformData& waveform, const ImVec4& color);
+
+// Draws a batch: section spans as filled rectangles, point markers as one
+// PlotInfLines per intensity, and a count badge over lines standing for
+// more than one marker. Suggested markers are faded and get no badges.
+void renderMarkerBatch(const MarkerBatch& batch, double samplesPerPixel, bool suggested = false);